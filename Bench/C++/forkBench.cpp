@@ -0,0 +1,495 @@
+// Measure the statement scheduling runtime from C++
+// Every scenario calls the hidden runtime functions exactly like JIT'd Fork code does
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include "../../lib.h"
+
+extern "C" void do_work_ms(int64_t i);
+
+// Statements receive their environment through a pointer, like Fork lambdas
+struct IntEnv {
+  int64_t n;
+};
+
+int64_t fib_statement(void* env);
+void sleep_statement(void* env);
+int64_t tiny_statement(void* env);
+
+// Same shape as Bench/Fork/fib_par.fk, both recursive calls are forked
+int64_t fib(int64_t n) {
+  if (n < 2) {
+    return n;
+  }
+  IntEnv e0 = {n-1};
+  IntEnv e1 = {n-2};
+  int64_t cid = __make_context(2);
+  __fork_sched_int((void*)&fib_statement,&e0,0,cid);
+  __fork_sched_int((void*)&fib_statement,&e1,1,cid);
+  int64_t a = __recon_int(0,1,0,1,cid);
+  int64_t b = __recon_int(0,1,1,1,cid);
+  __destroy_context(cid);
+  return a+b;
+}
+
+int64_t fib_statement(void* env) {
+  return fib(((IntEnv*)env)->n);
+}
+
+void sleep_statement(void* env) {
+  do_work_ms(((IntEnv*)env)->n);
+}
+
+int64_t tiny_statement(void* env) {
+  return ((IntEnv*)env)->n + 1;
+}
+
+// Holds its thread like CPU-bound work would, even when statements run on fibers
+void busy_statement(void* env) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(((IntEnv*)env)->n));
+}
+
+void long_statement(void* env) {
+  busy_statement(env);
+}
+
+// Binary tree of blocking work, every node forks both subtrees
+// Waiting parents run other nodes, so time should drop linearly with FORK_THREADS
+void tree_statement(void* env) {
+  int64_t depth = ((IntEnv*)env)->n;
+  do_work_ms(1);
+  if (depth == 0) {
+    return;
+  }
+  IntEnv child = {depth-1};
+  int64_t cid = __make_context(2);
+  __fork_sched_void((void*)&tree_statement,&child,0,cid);
+  __fork_sched_void((void*)&tree_statement,&child,1,cid);
+  __recon_void(0,1,cid);
+  __recon_void(1,1,cid);
+  __destroy_context(cid);
+}
+
+int64_t serial_fib(int64_t n) {
+  return (n < 2) ? n : serial_fib(n-1) + serial_fib(n-2);
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Testing/Programs/work_par.fk with a configurable sleep
+void bench_work_par(int64_t ms) {
+  IntEnv env = {ms};
+  auto start = std::chrono::steady_clock::now();
+  int64_t cid = __make_context(3);
+  for (int64_t id = 0; id < 3; id++) {
+    __fork_sched_void((void*)&sleep_statement,&env,id,cid);
+  }
+  for (int64_t id = 0; id < 3; id++) {
+    __recon_void(id,2,cid);
+  }
+  __destroy_context(cid);
+  std::cout << "work_par: 3 x do_work_ms(" << ms << "): " << elapsed_ms(start) << " ms" << std::endl;
+}
+
+// Fork-heavy recursion, two statements per call, compare with FORK_LAZY=0
+void bench_fib(int64_t n) {
+  auto start = std::chrono::steady_clock::now();
+  int64_t serial = serial_fib(n);
+  double serial_ms = elapsed_ms(start);
+  start = std::chrono::steady_clock::now();
+  int64_t result = fib(n);
+  double ms = elapsed_ms(start);
+  int64_t forks = 2*(serial_fib(n+1)-1);
+  std::cout << "fib(" << n << ") = " << result << ": " << ms << " ms, "
+            << (ms*1e6)/forks << " ns per forked statement (serial " << serial << ": " << serial_ms << " ms)" << std::endl;
+}
+
+// Many commit groups of trivial statements, measures pure runtime overhead
+void bench_flat(int64_t groups, int64_t width) {
+  IntEnv env = {1};
+  int64_t sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t g = 0; g < groups; g++) {
+    int64_t cid = __make_context(width);
+    for (int64_t id = 0; id < width; id++) {
+      __fork_sched_int((void*)&tiny_statement,&env,id,cid);
+    }
+    for (int64_t id = 0; id < width; id++) {
+      sum += __recon_int(0,1,id,width-1,cid);
+    }
+    __destroy_context(cid);
+  }
+  double ms = elapsed_ms(start);
+  std::cout << "flat: " << groups << " groups x " << width << " statements: " << ms << " ms, "
+            << (ms*1e6)/(groups*width) << " ns per statement (sum " << sum << ")" << std::endl;
+}
+
+// Same as flat, but each commit group is scheduled and reconciled with one call each
+void bench_group(int64_t groups, int64_t width) {
+  IntEnv env = {1};
+  int64_t sum = 0;
+  StatementDescriptor descriptors[64];
+  int64_t results[64];
+  for (int64_t id = 0; id < width; id++) {
+    descriptors[id] = {(void*)&tiny_statement,&env,SLOT_INT,0,0};
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t g = 0; g < groups; g++) {
+    int64_t cid = __make_context(width);
+    __fork_sched_group(descriptors,width,cid);
+    __recon_group(results,width,cid);
+    for (int64_t id = 0; id < width; id++) {
+      sum += results[id];
+    }
+    __destroy_context(cid);
+  }
+  double ms = elapsed_ms(start);
+  std::cout << "group: " << groups << " groups x " << width << " statements: " << ms << " ms, "
+            << (ms*1e6)/(groups*width) << " ns per statement (sum " << sum << ")" << std::endl;
+}
+
+void bench_tree(int64_t depth) {
+  IntEnv env = {depth};
+  auto start = std::chrono::steady_clock::now();
+  tree_statement(&env);
+  std::cout << "tree: " << (1 << (depth+1)) - 1 << " nodes x do_work_ms(1) on " << get_max_threads()
+            << " workers: " << elapsed_ms(start) << " ms" << std::endl;
+}
+
+// One wide group of sleeping statements, far more than the pool has workers
+// Compare FORK_SATURATION=queue, inline and deferred
+void bench_saturate(int64_t width, int64_t ms) {
+  IntEnv env = {ms};
+  auto start = std::chrono::steady_clock::now();
+  int64_t cid = __make_context(width);
+  for (int64_t id = 0; id < width; id++) {
+    __fork_sched_void((void*)&sleep_statement,&env,id,cid);
+  }
+  for (int64_t id = 0; id < width; id++) {
+    __recon_void(id,width-1,cid);
+  }
+  __destroy_context(cid);
+  std::cout << "saturate: " << width << " x do_work_ms(" << ms << ") on " << get_max_threads()
+            << " workers: " << elapsed_ms(start) << " ms" << std::endl;
+}
+
+// One long statement in the middle of a group of short ones, repeated so the runtime learns
+// The first round schedules in program order, later rounds should start the long one first
+// Compare FORK_HISTORY=0, run with FORK_THREADS=4 or more
+void bench_skewed(int64_t rounds, int64_t width, int64_t short_ms, int64_t long_ms) {
+  IntEnv short_env = {short_ms};
+  IntEnv long_env = {long_ms};
+  StatementDescriptor descriptors[64];
+  int64_t results[64];
+  for (int64_t id = 0; id < width; id++) {
+    descriptors[id] = {(void*)&busy_statement,&short_env,SLOT_VOID,0,0};
+  }
+  descriptors[width/2] = {(void*)&long_statement,&long_env,SLOT_VOID,0,0};
+  for (int64_t round = 0; round < rounds; round++) {
+    auto start = std::chrono::steady_clock::now();
+    int64_t cid = __make_context(width);
+    __fork_sched_group(descriptors,width,cid);
+    __recon_group(results,width,cid);
+    __destroy_context(cid);
+    std::cout << "skewed: round " << round << ", " << width-1 << " x " << short_ms << " ms + 1 x " << long_ms
+              << " ms on " << get_max_threads() << " workers: " << elapsed_ms(start) << " ms" << std::endl;
+  }
+}
+
+// Chunk of the distance kernel from Testing/Programs/perf.fk
+struct DistanceEnv {
+  float* xs;
+  float* ys;
+  float* distances;
+  int64_t begin;
+  int64_t end;
+  int64_t passes;
+};
+
+// Touches its chunk first so the pages land on the node of the worker that runs it
+void distance_statement(void* env) {
+  DistanceEnv* e = (DistanceEnv*)env;
+  for (int64_t i = e->begin; i < e->end; i++) {
+    e->xs[i] = (i % 1024)/1024.0f;
+    e->ys[i] = (i / 1024 % 1024)/1024.0f;
+  }
+  for (int64_t pass = 0; pass < e->passes; pass++) {
+    for (int64_t i = e->begin; i < e->end; i++) {
+      float dx = e->xs[i] - 0.5f;
+      float dy = e->ys[i] - 0.5f;
+      e->distances[i] = std::sqrt(dx*dx + dy*dy);
+    }
+  }
+}
+
+// Memory-bound kernel over arrays far larger than the caches, one chunk per statement
+// Compare FORK_PIN=core and FORK_PIN=node against the unpinned default on a NUMA machine
+void bench_distance(int64_t points, int64_t chunks, int64_t passes) {
+  float* xs = calloc_float(points);
+  float* ys = calloc_float(points);
+  float* distances = calloc_float(points);
+  DistanceEnv envs[64];
+  StatementDescriptor descriptors[64];
+  int64_t results[64];
+  for (int64_t c = 0; c < chunks; c++) {
+    envs[c] = {xs,ys,distances,points*c/chunks,points*(c+1)/chunks,passes};
+    descriptors[c] = {(void*)&distance_statement,&envs[c],SLOT_VOID,0,0};
+  }
+  auto start = std::chrono::steady_clock::now();
+  int64_t cid = __make_context(chunks);
+  __fork_sched_group(descriptors,chunks,cid);
+  __recon_group(results,chunks,cid);
+  __destroy_context(cid);
+  double ms = elapsed_ms(start);
+  int64_t inside = 0;
+  for (int64_t i = 0; i < points; i++) {
+    inside += distances[i] < 0.5f;
+  }
+  std::cout << "distance: " << points << " points x " << passes << " passes in " << chunks << " chunks on "
+            << get_max_threads() << " workers, " << get_numa_nodes() << " NUMA nodes: " << ms << " ms ("
+            << inside << " inside)" << std::endl;
+  free_float(xs);
+  free_float(ys);
+  free_float(distances);
+}
+
+// One pass over a chunk that stays in the cache of the worker that ran it last time
+void pass_statement(void* env) {
+  DistanceEnv* e = (DistanceEnv*)env;
+  for (int64_t i = e->begin; i < e->end; i++) {
+    float dx = e->xs[i] - 0.5f;
+    float dy = e->ys[i] - 0.5f;
+    e->distances[i] += std::sqrt(dx*dx + dy*dy);
+  }
+}
+
+// Repeated commits over the same arrays, the hint combines the pointers the way the compiler does
+// Compare FORK_LOCALITY=0, FORK_REPORT shows how many chunks ran on their previous worker
+void bench_locality(int64_t points, int64_t chunks, int64_t passes) {
+  float* xs = calloc_float(points);
+  float* ys = calloc_float(points);
+  float* distances = calloc_float(points);
+  DistanceEnv envs[64];
+  StatementDescriptor descriptors[64];
+  int64_t results[64];
+  int64_t hint = ((int64_t)(intptr_t)xs*31 + (int64_t)(intptr_t)ys)*31 + (int64_t)(intptr_t)distances;
+  for (int64_t c = 0; c < chunks; c++) {
+    envs[c] = {xs,ys,distances,points*c/chunks,points*(c+1)/chunks,1};
+    descriptors[c] = {(void*)&pass_statement,&envs[c],SLOT_VOID,hint,0};
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t pass = 0; pass < passes; pass++) {
+    int64_t cid = __make_context(chunks);
+    __fork_sched_group(descriptors,chunks,cid);
+    __recon_group(results,chunks,cid);
+    __destroy_context(cid);
+  }
+  std::cout << "locality: " << points << " points x " << passes << " commits of " << chunks << " chunks on "
+            << get_max_threads() << " workers: " << elapsed_ms(start)/passes << " ms per commit" << std::endl;
+  free_float(xs);
+  free_float(ys);
+  free_float(distances);
+}
+
+// Same shape as count_less_than_one_half in Testing/Programs/perf.fk, one frame per element
+__attribute__((noinline)) int64_t count_down(volatile int64_t n) {
+  if (n == 0) {
+    return 0;
+  }
+  return count_down(n-1)+1;
+}
+
+int64_t deep_statement(void* env) {
+  return count_down(((IntEnv*)env)->n);
+}
+
+// Forked statements recursing depth levels, FORK_STACK_MB or the main thread's ulimit -s sizes their stacks
+// A depth that does not fit reports a stack overflow instead of crashing silently
+void bench_deep(int64_t width, int64_t depth) {
+  IntEnv env = {depth};
+  auto start = std::chrono::steady_clock::now();
+  int64_t cid = __make_context(width);
+  for (int64_t id = 0; id < width; id++) {
+    __fork_sched_int((void*)&deep_statement,&env,id,cid);
+  }
+  int64_t sum = 0;
+  for (int64_t id = 0; id < width; id++) {
+    sum += __recon_int(0,1,id,width-1,cid);
+  }
+  __destroy_context(cid);
+  std::cout << "deep: " << width << " x recursion " << depth << " levels: " << elapsed_ms(start) << " ms (sum "
+            << sum << ")" << std::endl;
+}
+
+// Pure integer work, its env holds no pointers so it may run in another process
+int64_t collatz_statement(void* env) {
+  int64_t first = ((IntEnv*)env)->n;
+  int64_t steps = 0;
+  for (int64_t i = first; i < first + 20000; i++) {
+    for (int64_t x = i; x != 1; x = (x & 1) ? 3*x+1 : x/2) {
+      steps++;
+    }
+  }
+  return steps;
+}
+
+// Worker processes only run statements listed here, as the compiler lists forked statements
+extern "C" const RemoteEntry __fork_entries[] = {{(void*)&collatz_statement,SLOT_INT},{nullptr,0}};
+
+// Commit groups of pointer-free statements, start workers with FORK_SERVE=port and
+// run with FORK_REMOTE=host:port,... to deal them over worker processes
+void bench_remote(int64_t width, int64_t rounds) {
+  IntEnv envs[64];
+  StatementDescriptor descriptors[64];
+  int64_t results[64];
+  for (int64_t id = 0; id < width; id++) {
+    envs[id] = {1 + id*20000};
+    descriptors[id] = {(void*)&collatz_statement,&envs[id],SLOT_INT,0,sizeof(IntEnv)};
+  }
+  auto start = std::chrono::steady_clock::now();
+  int64_t steps = 0;
+  for (int64_t round = 0; round < rounds; round++) {
+    int64_t cid = __make_context(width);
+    __fork_sched_group(descriptors,width,cid);
+    __recon_group(results,width,cid);
+    __destroy_context(cid);
+    for (int64_t id = 0; id < width; id++) {
+      steps += results[id];
+    }
+  }
+  std::cout << "remote: " << rounds << " groups x " << width << " statements: " << elapsed_ms(start)
+            << " ms (steps " << steps << ")" << std::endl;
+}
+
+struct ChainEnv {
+  int64_t* values;
+  int64_t first;
+  int64_t last;
+};
+
+// Stores and loads through __tx_store and __tx_load like JIT'd statements compiled with FORK_TRANSACTIONS
+// Every statement reads the last element of the previous chunk, so in id order the chunks form one prefix sum
+void chain_statement(void* env) {
+  ChainEnv* e = (ChainEnv*)env;
+  int64_t sum = (e->first > 0) ? __tx_load(&e->values[e->first-1]) : 0;
+  for (int64_t i = e->first; i < e->last; i++) {
+    sum += __tx_load(&e->values[i]);
+    __tx_store(&e->values[i],sum);
+  }
+}
+
+// Every statement doubles its own chunk, nothing conflicts
+void scale_statement(void* env) {
+  ChainEnv* e = (ChainEnv*)env;
+  for (int64_t i = e->first; i < e->last; i++) {
+    __tx_store(&e->values[i],__tx_load(&e->values[i])*2);
+  }
+}
+
+// Run with FORK_TRANSACTIONS=1 for serial results, without it the chained prefix sum races and is skipped
+void bench_transactions(int64_t elements, int64_t chunks, int64_t rounds) {
+  int64_t* values = malloc_int(elements);
+  int64_t* expected = malloc_int(elements);
+  ChainEnv envs[64];
+  StatementDescriptor descriptors[64];
+  int64_t results[64];
+  const char* names[] = {"disjoint","chained"};
+  void* statements[] = {(void*)&scale_statement,(void*)&chain_statement};
+  const char* transactional = getenv("FORK_TRANSACTIONS");
+  int64_t kinds = (transactional && strcmp(transactional,"0")) ? 2 : 1;
+  for (int64_t kind = 0; kind < kinds; kind++) {
+    for (int64_t c = 0; c < chunks; c++) {
+      envs[c] = {values,elements*c/chunks,elements*(c+1)/chunks};
+      descriptors[c] = {statements[kind],&envs[c],SLOT_VOID,0,0};
+    }
+    double ms = 0;
+    bool serial = true;
+    for (int64_t round = 0; round < rounds; round++) {
+      for (int64_t i = 0; i < elements; i++) {
+        values[i] = i % 7;
+        expected[i] = kind ? (i ? expected[i-1] : 0) + i % 7 : (i % 7)*2;
+      }
+      auto start = std::chrono::steady_clock::now();
+      int64_t cid = __make_context(chunks);
+      __fork_sched_group(descriptors,chunks,cid);
+      __recon_group(results,chunks,cid);
+      __destroy_context(cid);
+      ms += elapsed_ms(start);
+      serial &= !memcmp(values,expected,elements*sizeof(int64_t));
+    }
+    std::cout << "transactions: " << names[kind] << " " << chunks << " chunks of " << elements/chunks << ": " << ms/rounds
+              << " ms per commit (" << (serial ? "serial result" : "differs from serial") << ")" << std::endl;
+  }
+  free_int(values);
+  free_int(expected);
+}
+
+// Hundreds of concurrent sleeps, sleeping statements suspend their fiber instead of a thread
+// With fibers this takes about one sleep, FORK_FIBERS=0 shows the thread-bound time
+//   and FORK_COMPENSATION how much compensation workers for blocked ones recover
+void bench_sleepers(int64_t width, int64_t ms) {
+  IntEnv env = {ms};
+  auto start = std::chrono::steady_clock::now();
+  int64_t cid = __make_context(width);
+  for (int64_t id = 0; id < width; id++) {
+    __fork_sched_void((void*)&sleep_statement,&env,id,cid);
+  }
+  for (int64_t id = 0; id < width; id++) {
+    __recon_void(id,width-1,cid);
+  }
+  __destroy_context(cid);
+  std::cout << "sleepers: " << width << " x do_work_ms(" << ms << ") on " << get_max_threads()
+            << " workers: " << elapsed_ms(start) << " ms" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  const char* only = (argc > 1) ? argv[1] : "";
+  if (!*only || !strcmp(only,"work_par")) {
+    bench_work_par(200);
+  }
+  if (!*only || !strcmp(only,"fib")) {
+    bench_fib(18);
+  }
+  if (!*only || !strcmp(only,"flat")) {
+    bench_flat(2000,8);
+    bench_flat(500,32);
+  }
+  if (!*only || !strcmp(only,"group")) {
+    bench_group(2000,8);
+    bench_group(500,32);
+  }
+  if (!*only || !strcmp(only,"tree")) {
+    bench_tree(7);
+  }
+  if (!*only || !strcmp(only,"saturate")) {
+    bench_saturate(16,10);
+  }
+  if (!*only || !strcmp(only,"sleepers")) {
+    bench_sleepers(300,200);
+  }
+  if (!*only || !strcmp(only,"skewed")) {
+    bench_skewed(3,32,5,60);
+  }
+  if (!*only || !strcmp(only,"distance")) {
+    bench_distance(1 << 22,32,8);
+  }
+  if (!*only || !strcmp(only,"locality")) {
+    bench_locality(1 << 20,32,64);
+  }
+  if (!*only || !strcmp(only,"remote")) {
+    bench_remote(32,4);
+  }
+  if (!*only || !strcmp(only,"transactions")) {
+    bench_transactions(1 << 18,16,8);
+  }
+  if (!*only || !strcmp(only,"deep")) {
+    bench_deep(4,(argc > 2) ? atol(argv[2]) : 50000);
+  }
+  return 0;
+}
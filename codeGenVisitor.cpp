@@ -57,8 +57,8 @@ llvm::Type* CodeGenVisitor::getFuncRetType(llvm::Function* func) {
 	return func->getReturnType();
 }
 
-llvm::Type* CodeGenVisitor::getAllocaType(llvm::AllocaInst* alloca) {
-	return alloca->getAllocatedType();
+llvm::Type* CodeGenVisitor::getAllocaType(llvm::Value* alloca) {
+	return getPointedType(alloca); //an alloca or a variable bound to an address it does not own
 }
 llvm::Constant* CodeGenVisitor::getNullPointer(std::string typeName) {
 	if(structTypes.find(typeName) != structTypes.end()) {
@@ -129,61 +129,211 @@ llvm::Type* CodeGenVisitor::getTypeFromString(std::string typeName, bool isPoint
 	return (llvm::Type*) ErrorV("Invalid type detected");
 }
 
+//Lambdas are internal functions of the main module, so one context, module and builder serve both
 llvm::LLVMContext* CodeGenVisitor::getContext() {
-	if(insideLambda) {
-		return lambdaContext;
-	}
 	return mainContext;
 }
 
 llvm::IRBuilder<true, llvm::NoFolder>* CodeGenVisitor::getBuilder() {
-	if(insideLambda) {
-		return lambdaBuilder.get();
-	}
 	return mainBuilder.get();
 }
 
 llvm::Module* CodeGenVisitor::getModule() {
-	if(insideLambda) {
-		return lambdaModule.get();
-	}
 	return mainModule.get();
 }
 
 llvm::Value* CodeGenVisitor::getVoidValue() {
-	if(insideLambda) {
-		return lambdaVoidValue;
-	}
 	return mainVoidValue;
 }
 
 llvm::Constant* CodeGenVisitor::getIntNullPointer() {
-	if(insideLambda) {
-		return lambdaIntNullPointer;
-	}
 	return mainIntNullPointer;
 }
 
 llvm::Constant* CodeGenVisitor::getFloatNullPointer() {
-	if(insideLambda) {
-		return lambdaFloatNullPointer;
-	}
 	return mainFloatNullPointer;
 }
 
 llvm::Value* CodeGenVisitor::makeSched(llvm::Type* type) {
+	lambdaPointer = type->isPointerTy();
+	if(lambdaPointer) {
+		type = type->getContainedType(0);
+	}
 	if(type->isIntegerTy()) {
 		strcpy(lambdaKeyword, "int");
 	}
 	else if(type->isDoubleTy()) {
 		strcpy(lambdaKeyword, "float");
 	}
+	else if(type->isStructTy() && (lambdaPointer || lambdaBoxed)) {
+		std::string name = type->getStructName();
+		lambdaKeyword = (char *)GC_MALLOC_ATOMIC(name.size() + 1);
+		strcpy(lambdaKeyword, name.c_str());
+	}
 	else {
-		return ErrorV("Not yet implemented closure assignment to pointer or struct types");
+		return ErrorV("Not yet implemented closure assignment of struct values outside variables");
 	}
 	return nullptr;
 }
 
+llvm::Function* CodeGenVisitor::getRuntimeFunction(const char* name, llvm::FunctionType* type) {
+	llvm::Function* func = getModule()->getFunction(name);
+	if(!func) {
+		func = llvm::Function::Create(type, llvm::Function::ExternalLinkage, name, getModule());
+	}
+	return func;
+}
+
+//A defined function is pure when it only touches its own stack and calls pure functions
+//A function still being generated is not, its remaining statements are unknown
+bool CodeGenVisitor::pureFunction(llvm::Function* func, std::vector<llvm::Function*>& visited) {
+	if(func->isDeclaration()) { //extern and runtime functions
+		return false;
+	}
+	for(auto block = func->begin(), last = func->end(); block != last; ++block) {
+		if(!block->getTerminator()) {
+			return false;
+		}
+		for(auto inst = block->begin(), end = block->end(); inst != end; ++inst) {
+			llvm::Value* address = nullptr;
+			if(llvm::LoadInst* load = llvm::dyn_cast<llvm::LoadInst>(&*inst)) {
+				address = load->getPointerOperand();
+			}
+			else if(llvm::StoreInst* store = llvm::dyn_cast<llvm::StoreInst>(&*inst)) {
+				address = store->getPointerOperand();
+			}
+			else if(!llvm::isa<llvm::CallInst>(&*inst) && inst->mayReadOrWriteMemory()) {
+				return false;
+			}
+			if(!address) {
+				continue;
+			}
+			address = address->stripPointerCasts();
+			while(llvm::GEPOperator* field = llvm::dyn_cast<llvm::GEPOperator>(address)) { //struct fields of a local
+				address = field->getPointerOperand()->stripPointerCasts();
+			}
+			if(!llvm::isa<llvm::AllocaInst>(address)) { //memory behind a pointer
+				return false;
+			}
+		}
+	}
+	return pureCalls(func, visited);
+}
+
+//Every function the given one calls is pure, visited collects those already shown or being shown so recursion ends
+bool CodeGenVisitor::pureCalls(llvm::Function* func, std::vector<llvm::Function*>& visited) {
+	for(auto block = func->begin(), last = func->end(); block != last; ++block) {
+		for(auto inst = block->begin(), end = block->end(); inst != end; ++inst) {
+			llvm::CallInst* call = llvm::dyn_cast<llvm::CallInst>(&*inst);
+			if(!call) {
+				continue;
+			}
+			llvm::Function* callee = call->getCalledFunction();
+			if(!callee) {
+				return false;
+			}
+			if(callee == func || std::find(visited.begin(), visited.end(), callee) != visited.end()) {
+				continue;
+			}
+			visited.push_back(callee);
+			if(!pureFunction(callee, visited)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+//Worker processes run only statements listed in __fork_entries, {statement, SlotType} ended by a null statement
+//The table is rebuilt as statements are added, nothing refers to it inside the module
+void CodeGenVisitor::addRemoteEntry(llvm::Function* statement, int64_t type) {
+	for(auto it = remoteEntries.begin(), end = remoteEntries.end(); it != end; ++it) {
+		if(it->first == statement) {
+			return;
+		}
+	}
+	remoteEntries.push_back(std::make_pair(statement, type));
+	llvm::Type* i64 = llvm::Type::getInt64Ty(*getContext());
+	llvm::Type* i64Ptr = llvm::Type::getInt64PtrTy(*getContext());
+	llvm::StructType* entryType = llvm::StructType::get(*getContext(), {i64Ptr, i64});
+	std::vector<llvm::Constant*> entries;
+	for(auto it = remoteEntries.begin(), end = remoteEntries.end(); it != end; ++it) {
+		entries.push_back(llvm::ConstantStruct::get(entryType, {llvm::ConstantExpr::getBitCast(it->first, i64Ptr), 
+			llvm::ConstantInt::get(*getContext(), llvm::APInt(64, it->second, true))}));
+	}
+	entries.push_back(llvm::ConstantStruct::get(entryType, {getIntNullPointer(), llvm::ConstantInt::get(*getContext(), llvm::APInt(64, 0, true))}));
+	llvm::ArrayType* tableType = llvm::ArrayType::get(entryType, entries.size());
+	llvm::GlobalVariable* table = new llvm::GlobalVariable(*getModule(), tableType, true, llvm::GlobalValue::ExternalLinkage, 
+		llvm::ConstantArray::get(tableType, entries));
+	llvm::GlobalVariable* previous = getModule()->getGlobalVariable("__fork_entries");
+	if(previous) {
+		table->takeName(previous);
+		previous->eraseFromParent();
+	}
+	else {
+		table->setName("__fork_entries");
+	}
+}
+
+//With FORK_TRANSACTIONS every function reads memory through pointers with __tx_load, so a forked statement
+//and the functions it calls see its buffered stores, outside a forked statement the runtime reads plainly
+//Every scalar is 64 bits wide and passes through the runtime as its bit pattern
+llvm::Value* CodeGenVisitor::loadShared(llvm::LoadInst* load) {
+	llvm::Type* type = load->getType();
+	if(!transactional || !(type->isIntegerTy(64) || type->isDoubleTy() || type->isPointerTy())) {
+		return load;
+	}
+	llvm::Type* i64 = llvm::Type::getInt64Ty(*getContext());
+	llvm::Type* i64Ptr = llvm::Type::getInt64PtrTy(*getContext());
+	llvm::Function* txLoad = getRuntimeFunction("__tx_load", llvm::FunctionType::get(i64, {i64Ptr}, false));
+	llvm::Value* bits = getBuilder()->CreateCall(txLoad, {getBuilder()->CreateBitOrPointerCast(load->getPointerOperand(), i64Ptr)});
+	if(type->isDoubleTy()) {
+		return getBuilder()->CreateBitCast(bits, type);
+	}
+	if(type->isPointerTy()) {
+		return getBuilder()->CreateIntToPtr(bits, type);
+	}
+	return bits;
+}
+
+//Starting value of the private copy a reduction lambda updates, x - e is computed as x + (0 - e)
+llvm::Value* CodeGenVisitor::reductionIdentity(llvm::Type* type, int reduction) {
+	int64_t identity = (reduction == BOP_MULT) ? 1 : 0;
+	if(type->isDoubleTy()) {
+		return llvm::ConstantFP::get(*getContext(), llvm::APFloat((double)identity));
+	}
+	return llvm::ConstantInt::get(*getContext(), llvm::APInt(64, identity, true));
+}
+
+llvm::Value* CodeGenVisitor::combineReduction(llvm::Value* total, llvm::Value* partial, int reduction) {
+	bool isFloat = getValType(total)->isDoubleTy();
+	if(reduction == BOP_MULT) {
+		return isFloat ? getBuilder()->CreateFMul(total, partial) : getBuilder()->CreateMul(total, partial);
+	}
+	return isFloat ? getBuilder()->CreateFAdd(total, partial) : getBuilder()->CreateAdd(total, partial);
+}
+
+//With FORK_TRANSACTIONS every function stores through pointers with __tx_store, buffered until the forked
+//statement running it commits at recon, so a rerun never repeats a store that already reached memory
+void CodeGenVisitor::storeShared(llvm::Value* value, llvm::Value* address) {
+	llvm::Type* type = getValType(value);
+	if(!transactional || !(type->isIntegerTy(64) || type->isDoubleTy() || type->isPointerTy())) {
+		getBuilder()->CreateStore(value, address);
+		return;
+	}
+	llvm::Type* i64 = llvm::Type::getInt64Ty(*getContext());
+	llvm::Type* i64Ptr = llvm::Type::getInt64PtrTy(*getContext());
+	llvm::Function* txStore = getRuntimeFunction("__tx_store", llvm::FunctionType::get(getBuilder()->getVoidTy(), {i64Ptr, i64}, false));
+	llvm::Value* bits = value;
+	if(type->isDoubleTy()) {
+		bits = getBuilder()->CreateBitCast(value, i64);
+	}
+	else if(type->isPointerTy()) {
+		bits = getBuilder()->CreatePtrToInt(value, i64);
+	}
+	getBuilder()->CreateCall(txStore, {getBuilder()->CreateBitOrPointerCast(address, i64Ptr), bits});
+}
+
 llvm::Function* CodeGenVisitor::generateFunction(bool hasPointerType, std::string returnType, std::string name, std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>* arguments) {
 	llvm::FunctionType* funcType = nullptr;
 	llvm::Function* func = nullptr;
@@ -224,21 +374,26 @@ CodeGenVisitor::CodeGenVisitor(std::string name) {
 	insideLambda = false; //lambda
 	justReturned = false;
 	recon = false; //lambda
+	lambdaPointer = false; //lambda
+	lambdaBoxed = false; //lambda
 	executeCommit = true;
+	const char* transactions = getenv("FORK_TRANSACTIONS"); //read by the runtime as well
+	transactional = transactions && strcmp(transactions, "0");
+	const char* dataflowRecon = getenv("FORK_DATAFLOW");
+	dataflow = dataflowRecon && strcmp(dataflowRecon, "0");
+	const char* speculation = getenv("FORK_SPECULATE");
+	speculate = speculation && strcmp(speculation, "0");
+	blockDepth = 0; //lambda
+	currTouchesMemory = false; //lambda
 	populateSwitchMap();
 	mainContext = llvm::unwrap(LLVMContextCreate());
-	lambdaContext = llvm::unwrap(LLVMContextCreate());
 	mainJIT = llvm::make_unique<llvm::orc::KaleidoscopeJIT>();
-	lambdaJIT = llvm::make_unique<llvm::orc::KaleidoscopeJIT>();
 	mainModule = llvm::make_unique<llvm::Module>(name, *mainContext);
 	mainModule->setDataLayout(mainJIT->getTargetMachine().createDataLayout()); //set module for tracking and execution
 	mainBuilder = llvm::make_unique<llvm::IRBuilder<true, llvm::NoFolder>>(*mainContext); //set builder for IR insertion
 	mainVoidValue = llvm::ReturnInst::Create(*mainContext); 
-	lambdaVoidValue = llvm::ReturnInst::Create(*lambdaContext); 
 	mainFloatNullPointer = llvm::Constant::getNullValue(llvm::Type::getDoublePtrTy(*mainContext));
-	lambdaFloatNullPointer = llvm::Constant::getNullValue(llvm::Type::getDoublePtrTy(*lambdaContext));
-	mainIntNullPointer = llvm::Constant::getNullValue(llvm::Type::getInt64PtrTy(*mainContext));
-	lambdaIntNullPointer = llvm::Constant::getNullValue(llvm::Type::getInt64PtrTy(*lambdaContext)); // set default void and nullptr values, struct has to be retrieved
+	mainIntNullPointer = llvm::Constant::getNullValue(llvm::Type::getInt64PtrTy(*mainContext)); // set default void and nullptr values, struct has to be retrieved
 }
 
 void CodeGenVisitor::executeMain() {
@@ -251,8 +406,6 @@ void CodeGenVisitor::executeMain() {
 	    func(); //execute main
 	    printf("---> main() returns: void\n");
 	    delete mainVoidValue;
-	    delete lambdaVoidValue;
-	    LLVMContextDispose(llvm::wrap(lambdaContext));
 	    LLVMContextDispose(llvm::wrap(mainContext));
 	    mainJIT->removeModule(handle);
 	}
@@ -297,7 +450,7 @@ llvm::Value* CodeGenVisitor::visitFloat(Float* f) {
 
 /*================================Identifier================================*/
 llvm::Value* CodeGenVisitor::visitIdentifier(Identifier* i) {
-  llvm::AllocaInst* val = namedValues[i->name]; //find alloca in map
+  llvm::Value* val = namedValues[i->name]; //find variable address in map
   if (!val)
     return ErrorV("Attempt to generate code for not previously defined variable");
   return getBuilder()->CreateLoad(val, i->name); //load alloca value from map
@@ -511,22 +664,22 @@ llvm::Value* CodeGenVisitor::visitBlock(Block* b) {
 		if(!insideLambda) {
 			for(auto it = b->statements->begin(), end = b->statements->end(); it != end; ++it) { //create vector of statement commits
 				auto statement = *it;
-				commitVector.push_back(statement->statementCommits());
+				commitVector.push_back(statement->statementCommits() || !statement->lambdable()); //only lambdable statements fork
 			}
 			bool prev = true;
-			for(auto it = commitVector.begin(), end = commitVector.end(); it != end; ++it) { //modify vector of statement commits such that the last commit is concurrent as well
-				auto commit = *it;
-				if(!commit) { //if not commiting, return prev value
-					prev = commit;
+			for(size_t i = 0, end = commitVector.size(); i != end; ++i) { //modify vector of statement commits such that the last commit is concurrent as well
+				if(!commitVector.at(i)) { //if not commiting, return prev value
+					prev = false;
 				}
-				else { //if commiting and not prev value, set current to false and record to true
+				else { //if commiting and not prev value, set current to false when it can fork and record to true
 					if(!prev) { 
-						*it = false;
+						commitVector.at(i) = !b->statements->at(i)->lambdable();
 						prev = true;
 					}
 				}
 			}
 			executeCommit = true;
+			++blockDepth;
 		}
 		for(size_t i = 0, end = b->statements->size(); i != end; ++i) {
 			auto statement = b->statements->at(i);
@@ -535,192 +688,681 @@ llvm::Value* CodeGenVisitor::visitBlock(Block* b) {
 				commits = commitVector.at(i);
 			}
 			if(!commits) { //if must create lambda
+				syncGroups(statement);
 				if(executeCommit) {
-					executeCommit = false;
-					char* cid = (char *)GC_MALLOC_ATOMIC(4); 
-					strcpy(cid, "cid");
-					char* makeContextName = (char *)GC_MALLOC_ATOMIC(15); 
-					strcpy(makeContextName, "__make_context");
-					char* keyword = (char *)GC_MALLOC_ATOMIC(4); 
-					strcpy(keyword, "int");
-					FunctionCall* makeContext = new FunctionCall(new Identifier(makeContextName), new std::vector<Expression*, gc_allocator<Expression*>>());
-					VariableDefinition* cidDef = new VariableDefinition(new Keyword(keyword), new Identifier(cid), makeContext, false);
-					currCid = cidDef->acceptVisitor(this);
-					currId = 0;
-					//make cid that identifies this thread group
-				}
-				statement->setCommit(true);
-				//create env struct type
-				llvm::StructType* currStruct = llvm::StructType::create(*getContext(), "env"); //create env struct type
-				std::vector<std::string> stringVec;
-				std::vector<llvm::Type*> types;
-				std::vector<llvm::Value*> vals;
-				for(auto it = namedValues.begin(), end = namedValues.end(); it != end; ++it) {
-					stringVec.push_back(it->first);
-					types.push_back(getAllocaType(it->second));
-					vals.push_back(getBuilder()->CreateLoad(it->second, it->first));
-				}
-				currStruct->setBody(types); //insert type list into env
-				structTypes.insert(std::make_pair("env", std::make_tuple(currStruct, stringVec))); //add env and fields to struct list
-				//create env
-				llvm::AllocaInst* alloca = createAlloca(getBuilder()->GetInsertBlock()->getParent(), currStruct, "e0");
-				llvm::Constant* structDec = llvm::ConstantAggregateZero::get(currStruct);
-				getBuilder()->CreateStore(structDec, alloca);
-				namedValues.insert(std::make_pair("e0", alloca));
-				auto loadVal = getBuilder()->CreateLoad(alloca);
-				for(size_t i = 0, end = vals.size(); i != end; ++i) {
-					auto structFieldRef = getStructField("env", stringVec.at(i), alloca)->getPointerOperand();
-					getBuilder()->CreateStore(vals.at(i), structFieldRef);
-				}
-				auto copyValues = namedValues; //clone map
-				auto ip = getBuilder()->saveAndClearIP(); //store block insertion point
-				char* envType = (char *)GC_MALLOC_ATOMIC(5); 
-				strcpy(envType, "void");
-				char* envName = (char *)GC_MALLOC_ATOMIC(3); 
-				strcpy(envName, "e0");
-				char* identifier = (char *)GC_MALLOC_ATOMIC(32);
-				std::ostringstream ss;
-				ss << "lambda" << lambdaNum++;
-				strcpy(identifier, (ss.str()).c_str()); // name mangle the lambda
-				auto lambdaStatements = new std::vector<Statement*,gc_allocator<Statement*>>();
-				LambdaReconVisitor* lambdaVisitor = new LambdaReconVisitor(this);
-				statement->acceptVisitor(lambdaVisitor);
-				auto exprLHS = lambdaVisitor->getLHS();
-				auto exprRHS = lambdaVisitor->getRHS();
-				//get LHS and RHS
-				if(!exprLHS) {
-					lambdaStatements->push_back(statement);
-				}
-				lambdaStatements->push_back(new ReturnStatement(exprRHS)); //make inserted statements
-				lambdaKeyword = (char *)GC_MALLOC_ATOMIC(6); 
-				//make recon vector for assign statement
-				if(!exprLHS) {
-					strcpy(lambdaKeyword, "void");
-					reconVector.push_back(std::make_pair(nullptr, nullptr));
-				}
-				else {
-					recon = true;
-					AssignStatement* reconAssign = new AssignStatement(exprLHS, exprRHS);
-					reconAssign->acceptVisitor(this);
-					recon = false;
-				}
-				//pass struct to function def
-				insideLambda = true;
-				lambdaModule = llvm::make_unique<llvm::Module>(identifier, *lambdaContext);
-				lambdaModule->setDataLayout(lambdaJIT->getTargetMachine().createDataLayout());
-				lambdaBuilder = llvm::make_unique<llvm::IRBuilder<true, llvm::NoFolder>>(*lambdaContext);
-				auto envArg = new std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>();
-				envArg->push_back(new StructureDeclaration(new Identifier(envType), new Identifier(envName), true)); //add void* e0 env argument
-				FunctionDefinition* fd = new FunctionDefinition(new Keyword(lambdaKeyword), new Identifier(identifier), envArg, new Block(lambdaStatements), false);
-				fd->acceptVisitor(this);
-				if(!error) {
-					lambdaModule->dump();
-				}
-				insideLambda = false;
-				getBuilder()->restoreIP(ip); //restore block insertion point
-				namedValues = copyValues;
-				//make function pointer
-				auto handle = lambdaJIT->addModule(std::move(lambdaModule)); // JIT the module
-				auto lambdaSymbol = lambdaJIT->findSymbol(identifier); 
-				uint64_t lam = lambdaSymbol.getAddress(); //grab address of the lambda
-				auto lamInt = llvm::ConstantInt::get(*getContext(), llvm::APInt(64, lam, true));
-				auto lamPtr = castIntToPointer(lamInt);
-				//pass env as pointer
-				std::vector<llvm::Value*> schedVector;
-				schedVector.push_back(lamPtr);
-				schedVector.push_back(getBuilder()->CreateBitOrPointerCast((new AddressOfExpression(new Identifier(envName), nullptr))->acceptVisitor(this), 
-					llvm::PointerType::get(llvm::IntegerType::get(*getContext(), 64), 0)));
-				schedVector.push_back(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, currId++, true))); //id increments for next one, currId gives max + 1 in the end
-				schedVector.push_back(currCid); //cid
-				llvm::Function* lambdaCall = nullptr;
-				if(!strcmp(lambdaKeyword, "int")) {
-					lambdaCall = getModule()->getFunction("__fork_sched_int");
-				}
-				else if(!strcmp(lambdaKeyword, "float")) {
-					lambdaCall = getModule()->getFunction("__fork_sched_float");
-				}
-				else if(!strcmp(lambdaKeyword, "void")) {
-					lambdaCall = getModule()->getFunction("__fork_sched_void");
-				}
-				else {
-					lambdaCall = (llvm::Function*)ErrorV("Not yet implemented closure assignment to pointer or struct types");
+					int64_t statements = 0; //size of the commit group, one result slot each
+					for(size_t j = i; j != end && !commitVector.at(j); ++j) {
+						++statements;
+					}
+					openGroup(statements);
 				}
-				if(lambdaCall) {
-					lastVisited = getBuilder()->CreateCall(lambdaCall, schedVector); //create lambda call
+				if(llvm::Value* sched = forkStatement(statement)) {
+					lastVisited = sched;
 				}
-				structTypes.erase("env");
-				namedValues.erase("e0");
 			}
 			else {
 				if(!executeCommit && !insideLambda) {
 					executeCommit = true;
-					--currId;
-					for(size_t i = 0, end = reconVector.size(); i != end; ++i) {
-						char* reconName = (char *)GC_MALLOC_ATOMIC(15);
-						std::vector<llvm::Value*> reconVal;
-						if(llvm::Value* refVar = reconVector.at(i).second) {
-							llvm::Value* var = getBuilder()->CreateLoad(reconVector.at(i).second);
-							if(getValType(var)->isIntegerTy()) {
-								strcpy(reconName, "__recon_int");
-							}
-							else if(getValType(var)->isDoubleTy()) {
-								strcpy(reconName, "__recon_float");
-							}
-							else {
-								break;
-							}
-							reconVal.push_back(var);
-							reconVal.push_back(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, 1, true)));
-							reconVal.push_back(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, i, true)));
-							reconVal.push_back(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, currId, true)));
-							reconVal.push_back(currCid);
-							llvm::Function* reconFun = getModule()->getFunction(reconName);
-							auto reconCall = getBuilder()->CreateCall(reconFun, reconVal);
-							getBuilder()->CreateStore(reconCall, refVar);
-						}
-						else {
-							strcpy(reconName, "__recon_void");
-							reconVal.push_back(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, i, true)));
-							reconVal.push_back(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, currId, true)));
-							reconVal.push_back(currCid);
-							llvm::Function* reconFun = getModule()->getFunction(reconName);
-							getBuilder()->CreateCall(reconFun, reconVal);
-						}
-					}
-					char* destroyContextName = (char *)GC_MALLOC_ATOMIC(18); 
-					strcpy(destroyContextName, "__destroy_context");
-					auto destroyContextVal = new std::vector<Expression*, gc_allocator<Expression*>>();
-					char* cid = (char *)GC_MALLOC_ATOMIC(4); 
-					strcpy(cid, "cid");
-					destroyContextVal->push_back(new Identifier(cid));
-					FunctionCall* destroyContext = new FunctionCall(new Identifier(destroyContextName), destroyContextVal);
-					destroyContext->acceptVisitor(this);
-					namedValues.erase("cid");
-					//delete cid that identifies the previous thread group
+					pendingGroups.push_back(closeGroup());
+				}
+				if(!insideLambda) {
+					syncGroups(statement);
 				}
+				if(insideLambda || (!forkAsyncCall(statement) && !speculateIf(statement))) {
 					lastVisited = statement->acceptVisitor(this);
+				}
+			}
+		}
+		if(!insideLambda) {
+			if(!executeCommit) { //the block ends with forked statements, their group closes here
+				executeCommit = true;
+				pendingGroups.push_back(closeGroup());
 			}
+			flushGroups();
+			--blockDepth;
 		}
 	}
 	return lastVisited;
 }
 
-/*===============================FunctionCall===============================*/
-llvm::Value* CodeGenVisitor::visitFunctionCall(FunctionCall* f) {
-	llvm::Function* func = getModule()->getFunction(f->ident->name); //search func name in module
-	if(!func) { //func name does not exist
-		if(insideLambda) {
-			auto mainFunc = mainModule->getFunction(f->ident->name); //declare in lambda module
-			func = llvm::Function::Create(mainFunc->getFunctionType(), llvm::Function::ExternalLinkage, f->ident->name, getModule());
+//Starts a commit group of the given number of forked statements
+void CodeGenVisitor::openGroup(int64_t statements) {
+	executeCommit = false;
+	std::string cidString = "cid." + std::to_string(lambdaNum); //groups may be pending side by side, the dot keeps it apart from user identifiers
+	char* cid = (char *)GC_MALLOC_ATOMIC(cidString.size() + 1); 
+	strcpy(cid, cidString.c_str());
+	currCidName = cid;
+	currTargets.clear();
+	currTouchesMemory = false;
+	char* makeContextName = (char *)GC_MALLOC_ATOMIC(15); 
+	strcpy(makeContextName, "__make_context");
+	char* keyword = (char *)GC_MALLOC_ATOMIC(4); 
+	strcpy(keyword, "int");
+	auto makeContextArgs = new std::vector<Expression*, gc_allocator<Expression*>>();
+	makeContextArgs->push_back(new Integer(statements));
+	FunctionCall* makeContext = new FunctionCall(new Identifier(makeContextName), makeContextArgs);
+	VariableDefinition* cidDef = new VariableDefinition(new Keyword(keyword), new Identifier(cid), makeContext, false);
+	currCid = cidDef->acceptVisitor(this);
+	currId = 0;
+	currGroupSize = statements;
+	//descriptor {func, env, type, hint, size} per statement and one 64-bit result each, passed to the runtime in one call
+	llvm::Type* i64 = llvm::Type::getInt64Ty(*getContext());
+	llvm::Type* i64Ptr = llvm::Type::getInt64PtrTy(*getContext());
+	llvm::StructType* descriptorType = llvm::StructType::get(*getContext(), {i64Ptr, i64Ptr, i64, i64, i64});
+	llvm::Function* parent = getBuilder()->GetInsertBlock()->getParent();
+	currDescriptors = createAlloca(parent, llvm::ArrayType::get(descriptorType, statements), "descriptors");
+	currResults = createAlloca(parent, llvm::ArrayType::get(i64, statements), "results");
+	//make cid that identifies this thread group
+}
+
+//Forks one statement of the open commit group, scheduling the group after its last statement
+llvm::Value* CodeGenVisitor::forkStatement(Statement* statement) {
+	llvm::Value* sched = nullptr;
+	statement->setCommit(true);
+	LambdaReconVisitor* lambdaVisitor = new LambdaReconVisitor(this);
+	statement->acceptVisitor(lambdaVisitor);
+	auto exprLHS = lambdaVisitor->getLHS();
+	auto exprRHS = lambdaVisitor->getRHS();
+	//a struct value does not fit a result slot, the lambda stores it into a buffer of this function named by the env
+	llvm::AllocaInst* box = nullptr;
+	Identifier* variable = lambdaVisitor->getVariable();
+	if(variable && namedValues.find(variable->name) != namedValues.end()) {
+		llvm::Type* variableType = getAllocaType(namedValues.find(variable->name)->second);
+		if(variableType->isStructTy()) {
+			box = createAlloca(getBuilder()->GetInsertBlock()->getParent(), variableType, "box");
+		}
+	}
+	//create env struct type
+	llvm::StructType* currStruct = llvm::StructType::create(*getContext(), "env"); //create env struct type
+	std::vector<std::string> stringVec;
+	std::vector<llvm::Type*> types;
+	std::vector<llvm::Value*> vals;
+	for(auto it = namedValues.begin(), end = namedValues.end(); it != end; ++it) {
+		if(!statement->references(it->first.c_str())) { //only variables the statement may use are captured
+			continue;
+		}
+		llvm::Type* type = getAllocaType(it->second);
+		bool largeReadOnly = type->isStructTy() && !statement->assigns(it->first.c_str()) && 
+			getModule()->getDataLayout().getTypeAllocSize(type) > ENV_INLINE_BYTES;
+		if(largeReadOnly || statement->addresses(it->first.c_str())) { //by address, a copy would leave &name dangling
+			stringVec.push_back("&" + it->first);
+			types.push_back(llvm::PointerType::getUnqual(type));
+			vals.push_back(it->second);
+			continue;
+		}
+		stringVec.push_back(it->first);
+		types.push_back(type);
+		vals.push_back(getBuilder()->CreateLoad(it->second, it->first));
+	}
+	size_t captures = vals.size(); //the box address is not a capture
+	if(box) {
+		stringVec.push_back("__box");
+		types.push_back(llvm::PointerType::getUnqual(getAllocaType(box)));
+		vals.push_back(box);
+	}
+	//variables a forked if or block assigns come back through fields of their own, so a rerun still sees the captured values
+	std::vector<std::string> writes;
+	if(!exprLHS) {
+		for(size_t i = 0; i != captures; ++i) {
+			if(statement->assigns(stringVec.at(i).c_str())) {
+				writes.push_back(stringVec.at(i));
+			}
+		}
+		for(auto it = writes.begin(), end = writes.end(); it != end; ++it) {
+			llvm::Value* var = namedValues.find(*it)->second;
+			stringVec.push_back("__" + *it);
+			types.push_back(getAllocaType(var));
+			vals.push_back(getBuilder()->CreateLoad(var));
+		}
+	}
+	currStruct->setBody(types); //insert type list into env
+	structTypes.insert(std::make_pair("env", std::make_tuple(currStruct, stringVec))); //add env and fields to struct list
+	//create env
+	llvm::AllocaInst* alloca = createAlloca(getBuilder()->GetInsertBlock()->getParent(), currStruct, "e.0");
+	llvm::Constant* structDec = llvm::ConstantAggregateZero::get(currStruct);
+	getBuilder()->CreateStore(structDec, alloca);
+	namedValues.insert(std::make_pair("e.0", alloca));
+	auto loadVal = getBuilder()->CreateLoad(alloca);
+	for(size_t i = 0, end = vals.size(); i != end; ++i) {
+		auto structFieldRef = getStructField("env", stringVec.at(i), alloca)->getPointerOperand();
+		getBuilder()->CreateStore(vals.at(i), structFieldRef);
+	}
+	//a reduction x = x op e sees a private x holding the identity, recon combines the partial results
+	int reduction = lambdaVisitor->getReduction();
+	if(reduction >= 0) {
+		std::string accumulator = lambdaVisitor->getAccumulator()->name;
+		auto field = std::find(stringVec.begin(), stringVec.end(), accumulator);
+		llvm::Type* type = (field != stringVec.end()) ? types.at(field - stringVec.begin()) : nullptr;
+		if(type && (type->isIntegerTy(64) || type->isDoubleTy())) {
+			auto structFieldRef = getStructField("env", accumulator, alloca)->getPointerOperand();
+			getBuilder()->CreateStore(reductionIdentity(type, reduction), structFieldRef);
 		}
 		else {
-			return ErrorV("Unknown function reference");
+			reduction = -1;
 		}
 	}
-	if(func->arg_size() != f->args->size()) { //func name exists but wrong args
-		return ErrorV("Wrong number of arguments passed to function");
+	for(auto it = writes.begin(), end = writes.end(); it != end; ++it) {
+		auto structFieldRef = getStructField("env", "__" + *it, alloca)->getPointerOperand();
+		writebackVector.push_back(std::make_pair(structFieldRef, namedValues.find(*it)->second));
+	}
+	//a defined variable is declared before the fork and reconciled like an assigned one
+	VariableDefinition* definition = lambdaVisitor->getDefinition();
+	if(definition) {
+		(new VariableDefinition(definition->type, definition->ident, nullptr, definition->hasPointerType))->acceptVisitor(this);
+	}
+	//later statements that touch these wait for the group's recon
+	for(auto it = namedValues.begin(), end = namedValues.end(); it != end; ++it) {
+		bool addressed = statement->addresses(it->first.c_str());
+		if(statement->assigns(it->first.c_str()) || addressed) {
+			currTargets.push_back(it->first);
+		}
+		llvm::Type* type = getAllocaType(it->second);
+		if(addressed || ((type->isPointerTy() || type->isStructTy()) && statement->references(it->first.c_str()))) {
+			currTouchesMemory = true;
+		}
+	}
+	//locality hint: the captured pointers combined, statements over the same arrays share it
+	llvm::Type* hintType = llvm::Type::getInt64Ty(*getContext());
+	llvm::Value* hint = llvm::ConstantInt::get(*getContext(), llvm::APInt(64, 0, true));
+	for(size_t i = 0; i != captures; ++i) {
+		if(types.at(i)->isPointerTy() && stringVec.at(i)[0] != '&') { //stack addresses say nothing about the data
+			hint = getBuilder()->CreateMul(hint, llvm::ConstantInt::get(*getContext(), llvm::APInt(64, 31, true)));
+			hint = getBuilder()->CreateAdd(hint, getBuilder()->CreatePtrToInt(vals.at(i), hintType));
+		}
+	}
+	//env bytes when no capture is a pointer, cleared below unless the statement is pure with an int or float result
+	bool pointerFree = true;
+	for(size_t i = 0, end = types.size(); i != end; ++i) {
+		if(types.at(i)->isPointerTy()) {
+			pointerFree = false;
+		}
+	}
+	int64_t envSize = (pointerFree && writes.empty()) ? getModule()->getDataLayout().getTypeAllocSize(currStruct) : 0; //writes come back through the env
+	lambdaKeyword = (char *)GC_MALLOC_ATOMIC(6); 
+	lambdaPointer = false;
+	//make recon vector for assign statement, an element or field target is addressed here in the forking function
+	if(!exprLHS) {
+		strcpy(lambdaKeyword, "void");
+		reconVector.push_back(std::make_pair(nullptr, nullptr));
+	}
+	else {
+		recon = true;
+		lambdaBoxed = box != nullptr;
+		AssignStatement* reconAssign = new AssignStatement(exprLHS, exprRHS);
+		reconAssign->acceptVisitor(this);
+		recon = false;
+		lambdaBoxed = false;
+		if(box && !reconVector.empty()) {
+			reconVector.back().first = box;
+		}
+	}
+	reductionVector.push_back(reduction);
+	auto copyValues = namedValues; //clone map
+	auto ip = getBuilder()->saveAndClearIP(); //store block insertion point
+	char* envType = (char *)GC_MALLOC_ATOMIC(5); 
+	strcpy(envType, "void");
+	char* envName = (char *)GC_MALLOC_ATOMIC(4); 
+	strcpy(envName, "e.0");
+	char* identifier = (char *)GC_MALLOC_ATOMIC(32);
+	std::ostringstream ss;
+	ss << "__lambda" << lambdaNum++;
+	strcpy(identifier, (ss.str()).c_str()); // name mangle the lambda, reserved like the runtime's names
+	auto lambdaStatements = new std::vector<Statement*,gc_allocator<Statement*>>();
+	if(!exprLHS) {
+		lambdaStatements->push_back(statement);
+	}
+	lambdaStatements->push_back(new ReturnStatement(exprRHS)); //make inserted statements
+	//pass struct to function def
+	insideLambda = true;
+	auto envArg = new std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>();
+	envArg->push_back(new StructureDeclaration(new Identifier(envType), new Identifier(envName), true)); //add void* e.0 env argument
+	FunctionDefinition* fd = nullptr;
+	if(!strcmp(lambdaKeyword, "int") || !strcmp(lambdaKeyword, "float") || !strcmp(lambdaKeyword, "void")) {
+		fd = new FunctionDefinition(new Keyword(lambdaKeyword), new Identifier(identifier), envArg, new Block(lambdaStatements), lambdaPointer);
+	}
+	else { //struct or struct pointer result
+		fd = new FunctionDefinition(new Identifier(lambdaKeyword), new Identifier(identifier), envArg, new Block(lambdaStatements), lambdaPointer);
+	}
+	fd->acceptVisitor(this);
+	llvm::Function* lambda = getModule()->getFunction(identifier);
+	if(lambda) {
+		lambda->setLinkage(llvm::Function::InternalLinkage); //only reached through descriptors, free to inline into
+	}
+	if(!writes.empty() && !error) { //copy the assigned variables into their env fields where the lambda returns
+		for(auto block = lambda->begin(), last = lambda->end(); block != last; ++block) {
+			llvm::TerminatorInst* ret = block->getTerminator();
+			if(!ret || !llvm::isa<llvm::ReturnInst>(ret)) {
+				continue;
+			}
+			getBuilder()->SetInsertPoint(ret);
+			auto env = getBuilder()->CreateLoad(namedValues.find(envName)->second);
+			for(auto it = writes.begin(), end = writes.end(); it != end; ++it) {
+				auto structFieldRef = getStructField("env", "__" + *it, env)->getPointerOperand();
+				getBuilder()->CreateStore(getBuilder()->CreateLoad(namedValues.find(*it)->second), structFieldRef);
+			}
+		}
+	}
+	if(box && !error) { //the runtime calls a wrapper that stores the struct into the box and returns its address
+		llvm::Type* i64Ptr = llvm::Type::getInt64PtrTy(*getContext());
+		std::string boxName = std::string(identifier) + "_box";
+		llvm::Function* boxFunc = llvm::Function::Create(llvm::FunctionType::get(i64Ptr, {i64Ptr}, false), llvm::Function::InternalLinkage, boxName, getModule());
+		getBuilder()->SetInsertPoint(llvm::BasicBlock::Create(*getContext(), "func", boxFunc));
+		llvm::Value* envValue = &*boxFunc->arg_begin();
+		llvm::StructType* envType = std::get<0>(structTypes.find("env")->second);
+		auto envPtr = getBuilder()->CreateBitOrPointerCast(envValue, llvm::PointerType::getUnqual(envType));
+		auto buffer = getBuilder()->CreateLoad(getBuilder()->CreateStructGEP(envType, envPtr, captures));
+		getBuilder()->CreateStore(getBuilder()->CreateCall(getModule()->getFunction(identifier), {envValue}), buffer);
+		getBuilder()->CreateRet(getBuilder()->CreateBitOrPointerCast(buffer, i64Ptr));
+		strcpy(identifier, boxName.c_str());
+	}
+	insideLambda = false;
+	getBuilder()->restoreIP(ip); //restore block insertion point
+	namedValues = copyValues;
+	//the descriptor refers to the lambda by symbol, it is compiled with the rest of the module
+	llvm::Function* lambdaFunc = getModule()->getFunction(identifier);
+	llvm::Value* lamPtr = getIntNullPointer();
+	if(lambdaFunc) {
+		lamPtr = getBuilder()->CreateBitOrPointerCast(lambdaFunc, llvm::Type::getInt64PtrTy(*getContext()));
+	}
+	//fill the descriptor of this statement, type values match SlotType in parContextManager.h
+	int64_t slotType = -1;
+	if(box || (lambdaPointer && strcmp(lambdaKeyword, "float"))) {
+		slotType = 2; //SLOT_INTPTR, struct pointers and boxed structs travel as int pointers
+	}
+	else if(lambdaPointer) {
+		slotType = 3; //SLOT_FLOATPTR
+	}
+	else if(!strcmp(lambdaKeyword, "int")) {
+		slotType = 0; //SLOT_INT
+	}
+	else if(!strcmp(lambdaKeyword, "float")) {
+		slotType = 1; //SLOT_FLOAT
+	}
+	else if(!strcmp(lambdaKeyword, "void")) {
+		slotType = 4; //SLOT_VOID
+	}
+	else {
+		ErrorV("Not yet implemented closure assignment of struct values outside variables");
+	}
+	std::vector<llvm::Function*> visited;
+	if(slotType != 0 && slotType != 1) { //void statements act only through side effects, those stay in this process
+		envSize = 0;
+	}
+	else if(envSize > 0 && (!lambdaFunc || !pureCalls(lambdaFunc, visited))) { //a worker process has only the env
+		envSize = 0;
+	}
+	if(slotType >= 0) {
+		llvm::Type* descriptorType = getAllocaType(currDescriptors)->getArrayElementType();
+		auto descriptor = getBuilder()->CreateConstGEP2_32(getAllocaType(currDescriptors), currDescriptors, 0, currId);
+		auto env = getBuilder()->CreateBitOrPointerCast((new AddressOfExpression(new Identifier(envName), nullptr))->acceptVisitor(this), 
+			llvm::PointerType::get(llvm::IntegerType::get(*getContext(), 64), 0)); //pass env as pointer
+		getBuilder()->CreateStore(lamPtr, getBuilder()->CreateStructGEP(descriptorType, descriptor, 0));
+		getBuilder()->CreateStore(env, getBuilder()->CreateStructGEP(descriptorType, descriptor, 1));
+		getBuilder()->CreateStore(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, slotType, true)), getBuilder()->CreateStructGEP(descriptorType, descriptor, 2));
+		getBuilder()->CreateStore(hint, getBuilder()->CreateStructGEP(descriptorType, descriptor, 3));
+		getBuilder()->CreateStore(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, envSize, true)), getBuilder()->CreateStructGEP(descriptorType, descriptor, 4));
+		if(lambdaFunc && envSize > 0) { //a statement the runtime may ship to worker processes
+			addRemoteEntry(lambdaFunc, slotType);
+		}
+	}
+	if(++currId == currGroupSize) { //last statement of the group, schedule all of them at once
+		std::vector<llvm::Value*> schedVector;
+		schedVector.push_back(getBuilder()->CreateBitOrPointerCast(currDescriptors, llvm::Type::getInt64PtrTy(*getContext())));
+		schedVector.push_back(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, currGroupSize, true)));
+		schedVector.push_back(currCid); //cid
+		sched = getBuilder()->CreateCall(getModule()->getFunction("__fork_sched_group"), schedVector);
+	}
+	structTypes.erase("env");
+	namedValues.erase("e.0");
+	return sched;
+}
+
+CodeGenVisitor::CommitGroup CodeGenVisitor::closeGroup() {
+	CommitGroup group;
+	group.cid = currCid;
+	group.cidName = currCidName;
+	group.results = currResults;
+	group.size = currGroupSize;
+	group.depth = blockDepth;
+	group.touchesMemory = currTouchesMemory;
+	group.targets.swap(currTargets);
+	group.recons.swap(reconVector);
+	group.reductions.swap(reductionVector);
+	group.writebacks.swap(writebackVector);
+	group.future = false;
+	group.taken = nullptr;
+	group.thenBegin = group.elseBegin = group.writebacks.size();
+	return group;
+}
+
+//Waits for the group, stores its results and destroys its context
+void CodeGenVisitor::reconGroup(const CommitGroup& group) {
+	std::vector<llvm::Value*> reconVal;
+	reconVal.push_back(getBuilder()->CreateBitOrPointerCast(group.results, llvm::Type::getInt64PtrTy(*getContext())));
+	reconVal.push_back(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, group.size, true)));
+	llvm::Value* taken = nullptr;
+	if(group.taken) { //the condition of a speculative if picks the branch whose writes are kept
+		llvm::Type* i64 = llvm::Type::getInt64Ty(*getContext());
+		llvm::Type* i64Ptr = llvm::Type::getInt64PtrTy(*getContext());
+		reconVal.push_back(getBuilder()->CreateBitOrPointerCast(group.taken, i64Ptr));
+		reconVal.push_back(group.cid);
+		llvm::Function* reconBranch = getRuntimeFunction("__recon_branch", llvm::FunctionType::get(i64, {i64Ptr, i64, i64Ptr, i64}, false));
+		taken = getBuilder()->CreateCall(reconBranch, reconVal); //cancels the losing branch
+	}
+	else {
+		reconVal.push_back(group.cid);
+		getBuilder()->CreateCall(getModule()->getFunction("__recon_group"), reconVal); //wait for the whole group
 	}
+	for(size_t i = 0, end = group.recons.size(); i != end; ++i) {
+		llvm::Value* refVar = group.recons.at(i).second;
+		if(!refVar) { //void statement, nothing to store
+			continue;
+		}
+		auto result = getBuilder()->CreateConstGEP2_32(getAllocaType(group.results), group.results, 0, i);
+		llvm::Value* value = nullptr;
+		llvm::Type* type = getPointedType(refVar);
+		if(group.recons.at(i).first) { //struct values wait in their box
+			value = getBuilder()->CreateLoad(group.recons.at(i).first);
+		}
+		else if(type->isIntegerTy()) {
+			value = getBuilder()->CreateLoad(result);
+		}
+		else if(type->isDoubleTy()) { //float results come back as their bit pattern
+			auto floatResult = getBuilder()->CreateBitOrPointerCast(result, llvm::Type::getDoublePtrTy(*getContext()));
+			value = getBuilder()->CreateLoad(floatResult);
+		}
+		else if(type->isPointerTy()) { //pointer results come back as their address
+			value = getBuilder()->CreateIntToPtr(getBuilder()->CreateLoad(result), type);
+		}
+		if(value && group.reductions.at(i) >= 0) { //partial results combine in id order, as serial code would
+			value = combineReduction(getBuilder()->CreateLoad(refVar), value, group.reductions.at(i));
+		}
+		if(value) {
+			getBuilder()->CreateStore(value, refVar);
+		}
+	}
+	for(size_t i = 0, end = group.thenBegin; i != end; ++i) { //forked compound statements in id order
+		getBuilder()->CreateStore(getBuilder()->CreateLoad(group.writebacks.at(i).first), group.writebacks.at(i).second);
+	}
+	if(taken) {
+		llvm::Function* func = getBuilder()->GetInsertBlock()->getParent();
+		llvm::BasicBlock* thenCopy = llvm::BasicBlock::Create(*getContext(), "then", func);
+		llvm::BasicBlock* elseCopy = llvm::BasicBlock::Create(*getContext(), "else", func);
+		llvm::BasicBlock* mergeCopy = llvm::BasicBlock::Create(*getContext(), "if", func);
+		getBuilder()->CreateCondBr(castIntToBoolean(taken), thenCopy, elseCopy);
+		getBuilder()->SetInsertPoint(thenCopy);
+		for(size_t i = group.thenBegin, end = group.elseBegin; i != end; ++i) {
+			getBuilder()->CreateStore(getBuilder()->CreateLoad(group.writebacks.at(i).first), group.writebacks.at(i).second);
+		}
+		getBuilder()->CreateBr(mergeCopy);
+		getBuilder()->SetInsertPoint(elseCopy);
+		for(size_t i = group.elseBegin, end = group.writebacks.size(); i != end; ++i) {
+			getBuilder()->CreateStore(getBuilder()->CreateLoad(group.writebacks.at(i).first), group.writebacks.at(i).second);
+		}
+		getBuilder()->CreateBr(mergeCopy);
+		getBuilder()->SetInsertPoint(mergeCopy);
+	}
+	char* destroyContextName = (char *)GC_MALLOC_ATOMIC(18); 
+	strcpy(destroyContextName, "__destroy_context");
+	auto destroyContextVal = new std::vector<Expression*, gc_allocator<Expression*>>();
+	destroyContextVal->push_back(new Identifier(group.cidName));
+	FunctionCall* destroyContext = new FunctionCall(new Identifier(destroyContextName), destroyContextVal);
+	destroyContext->acceptVisitor(this);
+	namedValues.erase(group.cidName); //delete cid that identifies the group
+}
+
+//Reconciles the pending groups a statement may depend on, every group without dataflow recon
+//  a statement that cannot run in a lambda may leave the function, so it waits for all of them
+void CodeGenVisitor::syncGroups(Statement* statement) {
+	bool all = !dataflow || !statement->enclosable();
+	for(size_t i = 0; i != pendingGroups.size();) {
+		const CommitGroup& group = pendingGroups.at(i);
+		bool needed = group.future ? !statement->enclosable() : all;
+		for(auto it = group.targets.begin(), end = group.targets.end(); !needed && it != end; ++it) {
+			needed = statement->references(it->c_str());
+		}
+		if(!needed && group.touchesMemory) { //any pointer may reach memory the group writes
+			for(auto it = namedValues.begin(), end = namedValues.end(); !needed && it != end; ++it) {
+				llvm::Type* type = getAllocaType(it->second);
+				needed = (type->isPointerTy() || type->isStructTy()) && statement->references(it->first.c_str());
+			}
+		}
+		if(needed) {
+			reconGroup(group);
+			pendingGroups.erase(pendingGroups.begin() + i);
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+//Groups forked in a block are reconciled before it ends, its control flow may not reach the next one
+void CodeGenVisitor::flushGroups() {
+	for(size_t i = 0; i != pendingGroups.size();) {
+		if(pendingGroups.at(i).depth < blockDepth) {
+			++i;
+			continue;
+		}
+		if(!getBuilder()->GetInsertBlock()->getTerminator()) { //nothing to emit after a return
+			reconGroup(pendingGroups.at(i));
+		}
+		pendingGroups.erase(pendingGroups.begin() + i);
+	}
+}
+
+//The runtime runs an async function through a thunk that loads its arguments from an env
+llvm::Function* CodeGenVisitor::generateAsyncThunk(llvm::Function* func) {
+	llvm::Type* retType = getFuncRetType(func);
+	if(retType->isStructTy()) {
+		return (llvm::Function*)ErrorV("Async functions cannot return struct values");
+	}
+	std::vector<llvm::Type*> params;
+	for(auto &arg : func->args()) {
+		params.push_back(arg.getType());
+	}
+	llvm::StructType* argsType = llvm::StructType::get(*getContext(), params); //literal, the same type at every call
+	llvm::Type* i64Ptr = llvm::Type::getInt64PtrTy(*getContext());
+	std::string thunkName = std::string(func->getName()) + "_async";
+	llvm::Function* thunk = llvm::Function::Create(llvm::FunctionType::get(retType, {i64Ptr}, false), llvm::Function::InternalLinkage, thunkName, getModule());
+	getBuilder()->SetInsertPoint(llvm::BasicBlock::Create(*getContext(), "func", thunk));
+	auto argsPtr = getBuilder()->CreateBitOrPointerCast(&*thunk->arg_begin(), llvm::PointerType::getUnqual(argsType));
 	std::vector<llvm::Value*> argVector;
+	for(size_t i = 0, end = params.size(); i != end; ++i) {
+		argVector.push_back(getBuilder()->CreateLoad(getBuilder()->CreateStructGEP(argsType, argsPtr, i)));
+	}
+	llvm::Value* result = getBuilder()->CreateCall(func, argVector);
+	if(retType->isVoidTy()) {
+		getBuilder()->CreateRetVoid();
+	}
+	else {
+		getBuilder()->CreateRet(result);
+	}
+	verifyFunction(*thunk);
+	return thunk;
+}
+
+//A committing statement that calls an async function, assigns its result to a variable or discards it
+//  schedules the call as a group of its own, the variable is a future reconciled before its first use
+bool CodeGenVisitor::forkAsyncCall(Statement* statement) {
+	LambdaReconVisitor* lambdaVisitor = new LambdaReconVisitor(this);
+	statement->acceptVisitor(lambdaVisitor);
+	LambdaReconVisitor* callVisitor = new LambdaReconVisitor(this); //only a call at the top of the statement
+	if(lambdaVisitor->getRHS()) {
+		lambdaVisitor->getRHS()->acceptVisitor(callVisitor);
+	}
+	else {
+		statement->acceptVisitor(callVisitor);
+	}
+	FunctionCall* call = callVisitor->getCall();
+	if(!call || asyncThunks.find(call->ident->name) == asyncThunks.end()) {
+		return false;
+	}
+	llvm::Function* thunk = asyncThunks.find(call->ident->name)->second;
+	llvm::Function* func = getModule()->getFunction(call->ident->name);
+	if(func->arg_size() != call->args->size()) { //reported by the plain call
+		return false;
+	}
+	Identifier* variable = lambdaVisitor->getVariable();
+	VariableDefinition* definition = lambdaVisitor->getDefinition();
+	if(lambdaVisitor->getLHS()) { //anything but a variable of the result type is assigned in place
+		llvm::Type* type = nullptr;
+		if(definition) {
+			if(namedValues.count(definition->ident->name) != 0) {
+				return false;
+			}
+			type = getTypeFromString(definition->stringType(), definition->hasPointerType, false);
+		}
+		else if(variable && namedValues.find(variable->name) != namedValues.end()) {
+			type = getAllocaType(namedValues.find(variable->name)->second);
+		}
+		if(!type || type != getFuncRetType(func)) {
+			return false;
+		}
+	}
+	std::vector<llvm::Value*> argVector;
+	if(!evaluateArgs(call, func, argVector)) {
+		return true; //reported
+	}
+	if(definition) {
+		(new VariableDefinition(definition->type, definition->ident, nullptr, definition->hasPointerType))->acceptVisitor(this);
+	}
+	CommitGroup group;
+	group.size = 1;
+	group.depth = blockDepth;
+	group.future = true;
+	group.taken = nullptr;
+	group.thenBegin = group.elseBegin = 0;
+	group.touchesMemory = false;
+	std::string cidString = "cid." + std::to_string(lambdaNum++);
+	group.cidName = (char *)GC_MALLOC_ATOMIC(cidString.size() + 1); 
+	strcpy(group.cidName, cidString.c_str());
+	char* makeContextName = (char *)GC_MALLOC_ATOMIC(15); 
+	strcpy(makeContextName, "__make_context");
+	char* keyword = (char *)GC_MALLOC_ATOMIC(4); 
+	strcpy(keyword, "int");
+	auto makeContextArgs = new std::vector<Expression*, gc_allocator<Expression*>>();
+	makeContextArgs->push_back(new Integer(1));
+	FunctionCall* makeContext = new FunctionCall(new Identifier(makeContextName), makeContextArgs);
+	group.cid = (new VariableDefinition(new Keyword(keyword), new Identifier(group.cidName), makeContext, false))->acceptVisitor(this);
+	//the arguments wait in a stack env of this function, which reconciles the future before it returns
+	llvm::Function* parent = getBuilder()->GetInsertBlock()->getParent();
+	std::vector<llvm::Type*> params;
+	for(auto it = argVector.begin(), end = argVector.end(); it != end; ++it) {
+		params.push_back(getValType(*it));
+	}
+	llvm::StructType* argsType = llvm::StructType::get(*getContext(), params);
+	llvm::AllocaInst* args = createAlloca(parent, argsType, "args");
+	llvm::Type* i64 = llvm::Type::getInt64Ty(*getContext());
+	llvm::Value* hint = llvm::ConstantInt::get(*getContext(), llvm::APInt(64, 0, true));
+	for(size_t i = 0, end = argVector.size(); i != end; ++i) {
+		getBuilder()->CreateStore(argVector.at(i), getBuilder()->CreateStructGEP(argsType, args, i));
+		if(params.at(i)->isPointerTy()) { //locality hint as for forked statements
+			hint = getBuilder()->CreateMul(hint, llvm::ConstantInt::get(*getContext(), llvm::APInt(64, 31, true)));
+			hint = getBuilder()->CreateAdd(hint, getBuilder()->CreatePtrToInt(argVector.at(i), i64));
+		}
+		if(params.at(i)->isPointerTy() || params.at(i)->isStructTy()) {
+			group.touchesMemory = true;
+		}
+	}
+	int64_t envSize = group.touchesMemory ? 0 : getModule()->getDataLayout().getTypeAllocSize(argsType);
+	//descriptor {func, env, type, hint, size}, type values match SlotType in parContextManager.h
+	llvm::Type* retType = getFuncRetType(func);
+	int64_t slotType = 4; //SLOT_VOID
+	if(retType->isIntegerTy()) {
+		slotType = 0; //SLOT_INT
+	}
+	else if(retType->isDoubleTy()) {
+		slotType = 1; //SLOT_FLOAT
+	}
+	else if(retType->isPointerTy()) {
+		slotType = retType->getContainedType(0)->isDoubleTy() ? 3 : 2; //SLOT_FLOATPTR, SLOT_INTPTR
+	}
+	std::vector<llvm::Function*> visited;
+	if((slotType != 0 && slotType != 1) || !pureCalls(thunk, visited)) { //as for forked statements, only pure scalar calls leave the process
+		envSize = 0;
+	}
+	llvm::Type* i64Ptr = llvm::Type::getInt64PtrTy(*getContext());
+	llvm::StructType* descriptorType = llvm::StructType::get(*getContext(), {i64Ptr, i64Ptr, i64, i64, i64});
+	llvm::AllocaInst* descriptors = createAlloca(parent, llvm::ArrayType::get(descriptorType, 1), "descriptors");
+	group.results = createAlloca(parent, llvm::ArrayType::get(i64, 1), "results");
+	auto descriptor = getBuilder()->CreateConstGEP2_32(getAllocaType(descriptors), descriptors, 0, 0);
+	getBuilder()->CreateStore(getBuilder()->CreateBitOrPointerCast(thunk, i64Ptr), getBuilder()->CreateStructGEP(descriptorType, descriptor, 0));
+	getBuilder()->CreateStore(getBuilder()->CreateBitOrPointerCast(args, i64Ptr), getBuilder()->CreateStructGEP(descriptorType, descriptor, 1));
+	getBuilder()->CreateStore(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, slotType, true)), getBuilder()->CreateStructGEP(descriptorType, descriptor, 2));
+	getBuilder()->CreateStore(hint, getBuilder()->CreateStructGEP(descriptorType, descriptor, 3));
+	getBuilder()->CreateStore(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, envSize, true)), getBuilder()->CreateStructGEP(descriptorType, descriptor, 4));
+	if(envSize > 0) {
+		addRemoteEntry(thunk, slotType);
+	}
+	std::vector<llvm::Value*> schedVector;
+	schedVector.push_back(getBuilder()->CreateBitOrPointerCast(descriptors, i64Ptr));
+	schedVector.push_back(llvm::ConstantInt::get(*getContext(), llvm::APInt(64, 1, true)));
+	schedVector.push_back(group.cid);
+	getBuilder()->CreateCall(getModule()->getFunction("__fork_sched_group"), schedVector);
+	llvm::Value* future = nullptr;
+	if(lambdaVisitor->getLHS()) {
+		future = namedValues.find(variable->name)->second;
+		group.targets.push_back(variable->name);
+	}
+	for(auto it = namedValues.begin(), end = namedValues.end(); it != end; ++it) { //the call may write through &name
+		if(call->addresses(it->first.c_str())) {
+			group.targets.push_back(it->first);
+		}
+	}
+	group.recons.push_back(std::make_pair(nullptr, future));
+	group.reductions.push_back(-1);
+	pendingGroups.push_back(group);
+	return true;
+}
+
+//FORK_SPECULATE runs an if statement whose condition calls a function and whose branches are pure
+//  as a commit group of the condition and both branches on copies of the variables,
+//  recon keeps the writes of the branch the condition picked and cancels the other one
+bool CodeGenVisitor::speculateIf(Statement* statement) {
+	if(!speculate) {
+		return false;
+	}
+	LambdaReconVisitor* lambdaVisitor = new LambdaReconVisitor(this);
+	statement->acceptVisitor(lambdaVisitor);
+	IfStatement* branch = lambdaVisitor->getBranch();
+	if(!branch || !branch->block || branch->exp->pure()) { //a condition without calls is cheaper to evaluate than to fork
+		return false;
+	}
+	if(!branch->block->pure() || (branch->else_block && !branch->else_block->pure())) {
+		return false;
+	}
+	//the condition sets a variable of its own, which the runtime reads to pick the branch
+	std::string takenString = "taken." + std::to_string(lambdaNum);
+	char* takenName = (char *)GC_MALLOC_ATOMIC(takenString.size() + 1); 
+	strcpy(takenName, takenString.c_str());
+	char* keyword = (char *)GC_MALLOC_ATOMIC(4); 
+	strcpy(keyword, "int");
+	(new VariableDefinition(new Keyword(keyword), new Identifier(takenName), new Integer(0), false))->acceptVisitor(this);
+	auto setTaken = new std::vector<Statement*,gc_allocator<Statement*>>();
+	setTaken->push_back(new AssignStatement(new Identifier(takenName), new Integer(1)));
+	openGroup(branch->else_block ? 3 : 2);
+	forkStatement(new IfStatement(branch->exp, new Block(setTaken), nullptr));
+	assert(writebackVector.size() == 1 && "The condition of a speculative if sets one variable");
+	size_t thenBegin = writebackVector.size();
+	forkStatement(new BlockStatement(branch->block));
+	size_t elseBegin = writebackVector.size();
+	if(branch->else_block) {
+		forkStatement(new BlockStatement(branch->else_block));
+	}
+	executeCommit = true;
+	CommitGroup group = closeGroup();
+	group.taken = group.writebacks.at(0).first;
+	group.thenBegin = thenBegin;
+	group.elseBegin = elseBegin;
+	reconGroup(group);
+	namedValues.erase(takenName);
+	return true;
+}
+
+/*===============================FunctionCall===============================*/
+//Evaluates the arguments of a call, casting them to the parameter types
+bool CodeGenVisitor::evaluateArgs(FunctionCall* f, llvm::Function* func, std::vector<llvm::Value*>& argVector) {
 	auto funcArgs = func->arg_begin();
 	for(size_t i = 0, end = f->args->size(); i != end; ++i) { //evaluate vector of args and type check
 		llvm::Value* argument = f->args->at(i)->acceptVisitor(this);
@@ -737,11 +1379,13 @@ llvm::Value* CodeGenVisitor::visitFunctionCall(FunctionCall* f) {
 					argument = getNullPointer(getPointedType(funcArgument)->getStructName());
 				}
 				else {
-					return ErrorV("Attempt to input NULL to function argument of incorrect pointer type");
+					ErrorV("Attempt to input NULL to function argument of incorrect pointer type");
+					return false;
 				}
 			}
 			else {
-				return ErrorV("Attempt to input NULL to function argument of incorrect type");
+				ErrorV("Attempt to input NULL to function argument of incorrect type");
+				return false;
 			}
 		}
 		if(getValType(argument) != getValType(funcArgument)) { //if int found instead of double, cast
@@ -755,11 +1399,27 @@ llvm::Value* CodeGenVisitor::visitFunctionCall(FunctionCall* f) {
 				argument = getBuilder()->CreateZExtOrBitCast(argument, getValType(funcArgument));
 			}
 			else { //if incorrect int or double size
-				return ErrorV("Invalid type as input for function args");
+				ErrorV("Invalid type as input for function args");
+				return false;
 			}
 		}
 		argVector.push_back(argument); //push the arg into the vector
 	}
+	return true;
+}
+
+llvm::Value* CodeGenVisitor::visitFunctionCall(FunctionCall* f) {
+	llvm::Function* func = getModule()->getFunction(f->ident->name); //search func name in module
+	if(!func) { //func name does not exist
+		return ErrorV("Unknown function reference");
+	}
+	if(func->arg_size() != f->args->size()) { //func name exists but wrong args
+		return ErrorV("Wrong number of arguments passed to function");
+	}
+	std::vector<llvm::Value*> argVector;
+	if(!evaluateArgs(f, func, argVector)) {
+		return nullptr; //reported
+	}
 	return getBuilder()->CreateCall(func, argVector); //establish function call with name and args
 }
 
@@ -959,12 +1619,23 @@ llvm::Value* CodeGenVisitor::visitFunctionDefinition(FunctionDefinition* f) {
 		auto varList = std::get<1>(structTuple);
 		for(size_t i = 0, end = varList.size(); i != end; ++i) {
 			llvm::Value* val = getStructField("env", varList.at(i), getBuilder()->CreateLoad(envAlloca));
-			llvm::AllocaInst* alloca = createAlloca(func, getValType(val), varList.at(i));
+			std::string name = varList.at(i);
+			if(name[0] == '&') { //passed by address, the name is bound to the caller's variable
+				namedValues.insert(std::make_pair(name.substr(1), val));
+				continue;
+			}
+			llvm::AllocaInst* alloca = createAlloca(func, getValType(val), name);
 			getBuilder()->CreateStore(val, alloca);
-			namedValues.insert(std::make_pair(varList.at(i), alloca));
+			namedValues.insert(std::make_pair(name, alloca));
 		}
 	}
 	llvm::Value* retVal = f->block->acceptVisitor(this);
+	if(f->async && !insideLambda && !error) {
+		llvm::Function* thunk = generateAsyncThunk(func);
+		if(thunk) {
+			asyncThunks.insert(std::make_pair(f->ident->name, thunk));
+		}
+	}
 	return retVal;
 }
 
@@ -1136,12 +1807,17 @@ llvm::Value* CodeGenVisitor::visitIfStatement(IfStatement* i) {
 	return getVoidValue(); //void val never used
 }
 
+/*=============================BlockStatement===============================*/
+llvm::Value* CodeGenVisitor::visitBlockStatement(BlockStatement* b) {
+	return b->block->acceptVisitor(this);
+}
+
 /*===============================PointerExpression================================*/
 llvm::Value* CodeGenVisitor::visitPointerExpression(PointerExpression* e) {
 	if(!e) {
 		return ErrorV("Unable to evaluate Pointer Expression");
 	}
-	llvm::AllocaInst* var = namedValues[e->ident->name];
+	llvm::Value* var = namedValues[e->ident->name];
 	if(!var) {
 		return ErrorV("Unable to evaluate variable");
 	}
@@ -1162,20 +1838,21 @@ llvm::Value* CodeGenVisitor::visitPointerExpression(PointerExpression* e) {
 		if(type->isStructTy()) {
 			std::string typeString = type->getStructName();
 			std::string fieldName = e->field->name;
-			return getStructField(typeString, fieldName, derefVar->getPointerOperand());
+			llvm::LoadInst* field = getStructField(typeString, fieldName, derefVar->getPointerOperand());
+			return field ? loadShared(field) : nullptr;
 		}
 		else {
 			return ErrorV("Unable to use dot operator on dereferenced non-struct type");
 		}
 	}
-	return derefVar; //pointer expression dereferenced
+	return loadShared(derefVar); //pointer expression dereferenced
 }
 
 /*===============================AddressOfExpression================================*/
 llvm::Value* CodeGenVisitor::visitAddressOfExpression(AddressOfExpression* e) {
 	if(!e)
 		return ErrorV("Unable to evaluate Address Expression");
-	llvm::AllocaInst* var = namedValues[e->ident->name];
+	llvm::Value* var = namedValues[e->ident->name];
 	if(!var) {
 		return ErrorV("Unable to evaluate variable");
 	}
@@ -1197,7 +1874,7 @@ llvm::Value* CodeGenVisitor::visitAddressOfExpression(AddressOfExpression* e) {
 llvm::Value* CodeGenVisitor::visitStructureExpression(StructureExpression* e) {
 	if(!e)
 		return ErrorV("Unable to evaluate Structure Expression");
-	llvm::AllocaInst* var = namedValues[e->ident->name]; //grab alloca
+	llvm::Value* var = namedValues[e->ident->name]; //grab alloca
 	if(!var) {
 		return ErrorV("Unable to evaluate variable");
 	}
@@ -1233,7 +1910,7 @@ llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitExpression(Expression* e
 }
 
 llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitIdentifier(Identifier* i) {
-	llvm::AllocaInst* var = c->namedValues[i->name];
+	llvm::Value* var = c->namedValues[i->name];
 	if(!var) {
 		return c->ErrorV("Unable to evaluate identifier left operand in assignment statement");
 	}
@@ -1279,7 +1956,7 @@ llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitIdentifier(Identifier* i
 }
 
 llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitPointerExpression(PointerExpression* e) { 
-	llvm::AllocaInst* var = c->namedValues[e->ident->name];
+	llvm::Value* var = c->namedValues[e->ident->name];
 	if(!var) {
 		return c->ErrorV("Unable to evaluate dereferenced identifier left operand in assignment statement");
 	}
@@ -1347,7 +2024,7 @@ llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitPointerExpression(Pointe
 			}
 		}
 	}
-	c->getBuilder()->CreateStore(right, refVar); //store RHS into deref LHS type/field
+	c->storeShared(right, refVar); //store RHS into deref LHS type/field
 	return right;	
 }
 
@@ -1356,7 +2033,7 @@ llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitAddressOfExpression(Addr
 }
 
 llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitStructureExpression(StructureExpression* e) {
-	llvm::AllocaInst* var = c->namedValues[e->ident->name];
+	llvm::Value* var = c->namedValues[e->ident->name];
 	if(!var) {
 		return c->ErrorV("Unable to evaluate accessed field of struct for left operand in assignment statement");
 	}
@@ -1419,6 +2096,7 @@ llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitExpressionStatement(Expr
 llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitReturnStatement(ReturnStatement* r) {return nullptr;}
 llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitAssignStatement(AssignStatement* a) {return nullptr;}
 llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitIfStatement(IfStatement* i) {return nullptr;}
+llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitBlockStatement(BlockStatement* b) {return nullptr;}
 llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitExternStatement(ExternStatement* e) {return nullptr;}
 llvm::Value* CodeGenVisitor::AssignmentLHSVisitor::visitNullLiteral(NullLiteral* n) {return nullptr;}
 
@@ -1426,6 +2104,14 @@ LambdaReconVisitor::LambdaReconVisitor(CodeGenVisitor* c) {
 	this->c = c;
 	exprLHS = nullptr;
 	exprRHS = nullptr;
+	identifier = nullptr;
+	binary = nullptr;
+	accumulator = nullptr;
+	variable = nullptr;
+	definition = nullptr;
+	call = nullptr;
+	branch = nullptr;
+	reduction = -1;
 }
 Expression* LambdaReconVisitor::getRHS() {
 	return exprRHS;
@@ -1433,11 +2119,96 @@ Expression* LambdaReconVisitor::getRHS() {
 Expression* LambdaReconVisitor::getLHS() {
 	return exprLHS;
 }
+Identifier* LambdaReconVisitor::getAccumulator() {
+	return accumulator;
+}
+Identifier* LambdaReconVisitor::getVariable() {
+	return variable;
+}
+VariableDefinition* LambdaReconVisitor::getDefinition() {
+	return definition;
+}
+FunctionCall* LambdaReconVisitor::getCall() {
+	return call;
+}
+IfStatement* LambdaReconVisitor::getBranch() {
+	return branch;
+}
+int LambdaReconVisitor::getReduction() {
+	return reduction;
+}
 Expression* LambdaReconVisitor::visitNode(Node* n) {return nullptr;}
 Expression* LambdaReconVisitor::visitExpression(Expression* e) {return nullptr;}
 Expression* LambdaReconVisitor::visitStatement(Statement* s) {return nullptr;}
 Expression* LambdaReconVisitor::visitAssignStatement(AssignStatement* a) {
 	exprLHS = a->target;
 	exprRHS = a->valxp;
+	identifier = nullptr;
+	a->target->acceptVisitor(this);
+	Identifier* target = identifier;
+	variable = target;
+	binary = nullptr;
+	a->valxp->acceptVisitor(this);
+	BinaryOperator* update = binary;
+	if(!target || !update) {
+		return exprRHS;
+	}
+	int op = -1;
+	if(!strcmp(update->op, "+")) {
+		op = BOP_PLUS;
+	}
+	else if(!strcmp(update->op, "*")) {
+		op = BOP_MULT;
+	}
+	else if(!strcmp(update->op, "-")) {
+		op = BOP_MINUS; //x - e1 - e2 is x + (-e1) + (-e2)
+	}
+	else {
+		return exprRHS;
+	}
+	identifier = nullptr;
+	update->left->acceptVisitor(this);
+	Expression* operand = nullptr;
+	if(identifier && !strcmp(identifier->name, target->name)) {
+		operand = update->right;
+	}
+	else if(op != BOP_MINUS) {
+		identifier = nullptr;
+		update->right->acceptVisitor(this);
+		if(identifier && !strcmp(identifier->name, target->name)) {
+			operand = update->left;
+		}
+	}
+	if(operand && !operand->references(target->name)) {
+		accumulator = target;
+		reduction = op;
+	}
 	return exprRHS;
 }
+Expression* LambdaReconVisitor::visitVariableDefinition(VariableDefinition* v) {
+	definition = v;
+	variable = v->ident;
+	exprLHS = v->ident;
+	exprRHS = v->exp;
+	return exprRHS;
+}
+Expression* LambdaReconVisitor::visitExpressionStatement(ExpressionStatement* e) {
+	e->exp->acceptVisitor(this); //a discarded value is not returned
+	return nullptr;
+}
+Expression* LambdaReconVisitor::visitIfStatement(IfStatement* i) {
+	branch = i;
+	return nullptr;
+}
+Expression* LambdaReconVisitor::visitIdentifier(Identifier* i) {
+	identifier = i;
+	return i;
+}
+Expression* LambdaReconVisitor::visitBinaryOperator(BinaryOperator* b) {
+	binary = b;
+	return b;
+}
+Expression* LambdaReconVisitor::visitFunctionCall(FunctionCall* f) {
+	call = f;
+	return f;
+}
@@ -4,9 +4,13 @@
 #include "node.h"
 #include <iostream>
 #include <sstream>
+#include <algorithm>
 
 //AST visitor
 
+//Struct values a forked statement only reads are passed by address when larger than this
+#define ENV_INLINE_BYTES 64
+
 enum Binops {
 	BOP_PLUS,
 	BOP_MINUS,
@@ -43,6 +47,7 @@ public:
 	virtual llvm::Value* visitReturnStatement(ReturnStatement* r) =0;
 	virtual llvm::Value* visitAssignStatement(AssignStatement* a) =0;
 	virtual llvm::Value* visitIfStatement(IfStatement* i) =0;
+	virtual llvm::Value* visitBlockStatement(BlockStatement* b) =0;
 	virtual llvm::Value* visitPointerExpression(PointerExpression* e) =0;
 	virtual llvm::Value* visitAddressOfExpression(AddressOfExpression* e) =0;
 	virtual llvm::Value* visitStructureExpression(StructureExpression* e) =0;
@@ -77,38 +82,66 @@ private:
 		llvm::Value* visitReturnStatement(ReturnStatement* r);
 		llvm::Value* visitAssignStatement(AssignStatement* a);
 		llvm::Value* visitIfStatement(IfStatement* i);
+		llvm::Value* visitBlockStatement(BlockStatement* b);
 		llvm::Value* visitPointerExpression(PointerExpression* e);
 		llvm::Value* visitAddressOfExpression(AddressOfExpression* e);
 		llvm::Value* visitStructureExpression(StructureExpression* e);
 		llvm::Value* visitExternStatement(ExternStatement* e);
 		llvm::Value* visitNullLiteral(NullLiteral* n);
 	};
+	//A scheduled commit group and what its recon stores
+	struct CommitGroup {
+		llvm::Value* cid;
+		char* cidName;
+		llvm::AllocaInst* results;
+		int size;
+		int depth; //blockDepth of the block that forked it
+		bool touchesMemory; //a statement mentions a pointer or struct variable
+		std::vector<std::string> targets; //variables the recon assigns
+		std::vector<std::pair<llvm::Value*, llvm::Value*>> recons;
+		std::vector<int> reductions;
+		std::vector<std::pair<llvm::Value*, llvm::Value*>> writebacks;
+		bool future; //an async call, reconciled at first use with or without dataflow recon
+		llvm::Value* taken; //speculative if: env field the condition sets, nullptr for other groups
+		size_t thenBegin; //speculative if: first writeback of the then branch
+		size_t elseBegin; //speculative if: first writeback of the else branch
+	};
 	int lambdaNum; //lambda
 	bool insideLambda; //lambda
 	llvm::Value* currCid; //lambda
+	char* currCidName; //lambda
+	std::vector<std::string> currTargets; //lambda
+	bool currTouchesMemory; //lambda
+	std::vector<CommitGroup> pendingGroups; //lambda, closed groups not reconciled yet
+	bool dataflow; //lambda, FORK_DATAFLOW delays each recon until a statement depends on the group
+	bool speculate; //lambda, FORK_SPECULATE forks both branches of an if statement with the condition
+	int blockDepth; //lambda
 	int currId; //lambda
+	int currGroupSize; //lambda
+	llvm::AllocaInst* currDescriptors; //lambda
+	llvm::AllocaInst* currResults; //lambda
 	bool executeCommit; //lambda
+	bool transactional; //FORK_TRANSACTIONS routes pointer loads and stores of every function through the runtime
 	char* lambdaKeyword;
+	bool lambdaPointer; //lambda, the lambda returns a pointer to lambdaKeyword
+	bool lambdaBoxed; //lambda, a struct result may be returned through the env
 	bool error;
 	bool justReturned;
 	llvm::LLVMContext* mainContext;
-	llvm::LLVMContext* lambdaContext; //lambda
-	std::vector<std::pair<llvm::Value*, llvm::Value*>> reconVector;
+	std::vector<std::pair<llvm::Value*, llvm::Value*>> reconVector; //lambda, struct result buffer or nullptr, and the variable it reconciles into
+	std::vector<std::pair<llvm::Value*, llvm::Value*>> writebackVector; //lambda, env field and the variable a forked compound statement assigned
+	std::vector<int> reductionVector; //lambda, Binops combining each reconVector result into its variable, -1 to assign
 	std::unique_ptr<llvm::IRBuilder<true, llvm::NoFolder>> mainBuilder;
-	std::unique_ptr<llvm::IRBuilder<true, llvm::NoFolder>> lambdaBuilder; //lambda
 	std::unique_ptr<llvm::Module> mainModule;
-	std::unique_ptr<llvm::Module> lambdaModule; //lambda
 	std::unique_ptr<llvm::orc::KaleidoscopeJIT> mainJIT;
-	std::unique_ptr<llvm::orc::KaleidoscopeJIT> lambdaJIT; //lambda
 	llvm::Value* mainVoidValue;
-	llvm::Value* lambdaVoidValue; //lambda
 	llvm::Constant* mainIntNullPointer;
-	llvm::Constant* lambdaIntNullPointer; //lambda
 	llvm::Constant* mainFloatNullPointer;
-	llvm::Constant* lambdaFloatNullPointer; //lambda
-	std::unordered_map<std::string, llvm::AllocaInst*> namedValues;
+	std::unordered_map<std::string, llvm::Value*> namedValues;
 	std::unordered_map<std::string, std::tuple<llvm::StructType*, std::vector<std::string>>> structTypes;
 	std::unordered_map<std::string, Binops> switchMap;
+	std::unordered_map<std::string, llvm::Function*> asyncThunks; //lambda, thunk that runs each async function from an env of its arguments
+	std::vector<std::pair<llvm::Function*, int64_t>> remoteEntries; //lambda, statements worker processes may run and their SlotType
 	llvm::Value* ErrorV(const char* str);
 	void populateSwitchMap();
 	llvm::Value* castIntToFloat(llvm::Value* val);
@@ -120,17 +153,35 @@ private:
 	llvm::Type* getValType(llvm::Value* val);
 	llvm::Type* getPointedType(llvm::Value* val);
 	llvm::Type* getFuncRetType(llvm::Function* func);
-	llvm::Type* getAllocaType(llvm::AllocaInst* alloca);
+	llvm::Type* getAllocaType(llvm::Value* alloca);
 	llvm::Constant* getNullPointer(std::string typeName);
 	llvm::LoadInst* getStructField(std::string typeString, std::string fieldName, llvm::Value* var);
 	llvm::Type* getTypeFromString(std::string typeName, bool isPointer, bool allowsVoid);
-	llvm::Module* getModule(); //lambda
-	llvm::IRBuilder<true, llvm::NoFolder>* getBuilder(); //lambda
-	llvm::LLVMContext* getContext(); //lambda
+	llvm::Module* getModule();
+	llvm::IRBuilder<true, llvm::NoFolder>* getBuilder();
+	llvm::LLVMContext* getContext();
 	llvm::Value* getVoidValue();
 	llvm::Constant* getIntNullPointer();
 	llvm::Constant* getFloatNullPointer(); 
 	llvm::Value* makeSched(llvm::Type* type); //lambda
+	void openGroup(int64_t statements); //lambda
+	llvm::Value* forkStatement(Statement* statement); //lambda
+	CommitGroup closeGroup(); //lambda
+	void reconGroup(const CommitGroup& group); //lambda
+	void syncGroups(Statement* statement); //lambda
+	void flushGroups(); //lambda
+	llvm::Function* generateAsyncThunk(llvm::Function* func); //lambda
+	bool forkAsyncCall(Statement* statement); //lambda
+	bool speculateIf(Statement* statement); //lambda
+	bool evaluateArgs(FunctionCall* f, llvm::Function* func, std::vector<llvm::Value*>& argVector);
+	llvm::Function* getRuntimeFunction(const char* name, llvm::FunctionType* type); //lambda
+	void addRemoteEntry(llvm::Function* statement, int64_t type); //lambda
+	bool pureFunction(llvm::Function* func, std::vector<llvm::Function*>& visited); //lambda
+	bool pureCalls(llvm::Function* func, std::vector<llvm::Function*>& visited); //lambda
+	llvm::Value* loadShared(llvm::LoadInst* load);
+	llvm::Value* reductionIdentity(llvm::Type* type, int reduction); //lambda
+	llvm::Value* combineReduction(llvm::Value* total, llvm::Value* partial, int reduction); //lambda
+	void storeShared(llvm::Value* value, llvm::Value* address);
 	llvm::Function* generateFunction(bool hasPointerType, std::string returnType, std::string name, std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>* arguments);
 	llvm::AllocaInst* createAlloca(llvm::Function* func, llvm::Type* type, const std::string &name);
 public:
@@ -158,6 +209,7 @@ public:
 	llvm::Value* visitReturnStatement(ReturnStatement* r);
 	llvm::Value* visitAssignStatement(AssignStatement* a);
 	llvm::Value* visitIfStatement(IfStatement* i);
+	llvm::Value* visitBlockStatement(BlockStatement* b);
 	llvm::Value* visitPointerExpression(PointerExpression* r);
 	llvm::Value* visitAddressOfExpression(AddressOfExpression* r);
 	llvm::Value* visitStructureExpression(StructureExpression* r);
@@ -165,19 +217,41 @@ public:
 	llvm::Value* visitNullLiteral(NullLiteral* n);
 };
 
+//Finds the assignment a lambda returns, and whether it is a reduction x = x op e
+//  with an associative op and an e that does not read x
 class LambdaReconVisitor : public gc {
 private:
 	CodeGenVisitor* c;
 	Expression* exprLHS;
 	Expression* exprRHS;
+	Identifier* identifier; //last visited node, when it was one of these
+	BinaryOperator* binary;
+	Identifier* accumulator; //x of a reduction
+	Identifier* variable; //assigned variable when the LHS is a plain identifier
+	VariableDefinition* definition; //defining statement, the variable is declared before the fork
+	FunctionCall* call; //last visited call
+	IfStatement* branch; //visited if statement
+	int reduction; //Binops, -1 for none
 public:
 	Expression* getRHS();
 	Expression* getLHS();
+	Identifier* getAccumulator();
+	Identifier* getVariable();
+	VariableDefinition* getDefinition();
+	FunctionCall* getCall();
+	IfStatement* getBranch();
+	int getReduction();
 	LambdaReconVisitor(CodeGenVisitor* c);
 	Expression* visitNode(Node* n);
 	Expression* visitExpression(Expression* e);
 	Expression* visitStatement(Statement* s);
 	Expression* visitAssignStatement(AssignStatement* a);
+	Expression* visitVariableDefinition(VariableDefinition* v);
+	Expression* visitExpressionStatement(ExpressionStatement* e);
+	Expression* visitIfStatement(IfStatement* i);
+	Expression* visitIdentifier(Identifier* i);
+	Expression* visitBinaryOperator(BinaryOperator* b);
+	Expression* visitFunctionCall(FunctionCall* f);
 };
 
 #endif /* __CODE_GEN_VISIT_H */
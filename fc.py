@@ -46,7 +46,7 @@ def main():
         print("\nInvoking GCC assembler for static compilation...")
         os.system("gcc -c {0}.s -o {0}.o".format(basename))
         print("Linking executable...")
-        os.system("g++ -std=c++11 -fomit-frame-pointer -rdynamic -fvisibility-inlines-hidden -fno-exceptions -fno-rtti -fPIC -ffunction-sections -fdata-sections -Wl,-rpath=. -o {0}.bin {0}.o lib.o parContextManager.o".format(basename))
+        os.system("g++ -std=c++11 -fomit-frame-pointer -rdynamic -fvisibility-inlines-hidden -fno-exceptions -fno-rtti -fPIC -ffunction-sections -fdata-sections -Wl,-rpath=. -o {0}.bin {0}.o lib.o parContextManager.o workerPool.o fiber.o remote.o -lpthread".format(basename))
       else:
         os.system("./parser {}".format(file))
   #Postprocessing
@@ -0,0 +1,391 @@
+//Implementation of stackful fibers and their per-thread scheduler
+
+#include "fiber.h"
+#include <cassert>
+#include <algorithm>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#if defined(__SANITIZE_THREAD__)
+#define FIBER_TSAN
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define FIBER_TSAN
+#endif
+#endif
+
+#ifdef FIBER_TSAN
+#include <sanitizer/tsan_interface.h>
+#endif
+
+void fiber_start(Fiber* f);
+
+#if defined(__x86_64__)
+//Save callee-saved registers and the floating point control words on the old stack,
+//  then pop the same layout from the new one, no system call is involved
+extern "C" void fiber_switch(void** from, void* to);
+extern "C" void fiber_trampoline();
+extern "C" void fiber_enter(Fiber* f) {
+  fiber_start(f);
+}
+
+asm(
+  ".text\n"
+  ".globl fiber_switch\n"
+  ".type fiber_switch,@function\n"
+  "fiber_switch:\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq $8, %rsp\n"
+  "  stmxcsr (%rsp)\n"
+  "  fnstcw 4(%rsp)\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rsp\n"
+  "  ldmxcsr (%rsp)\n"
+  "  fldcw 4(%rsp)\n"
+  "  addq $8, %rsp\n"
+  "  popq %r15\n"
+  "  popq %r14\n"
+  "  popq %r13\n"
+  "  popq %r12\n"
+  "  popq %rbx\n"
+  "  popq %rbp\n"
+  "  ret\n"
+  ".size fiber_switch,.-fiber_switch\n"
+  ".globl fiber_trampoline\n"
+  ".type fiber_trampoline,@function\n"
+  "fiber_trampoline:\n"
+  "  movq %r12, %rdi\n"
+  "  call fiber_enter@PLT\n"
+  "  ud2\n"
+  ".size fiber_trampoline,.-fiber_trampoline\n"
+);
+
+//First switch into a new fiber pops this frame and returns into the trampoline
+static void prepare_stack(Fiber* f) {
+  uintptr_t top = ((uintptr_t)f->stack + f->size) & ~(uintptr_t)15;
+  uint64_t* frame = (uint64_t*)(top - 64);
+  uint32_t mxcsr;
+  uint16_t fpucw;
+  asm volatile("stmxcsr %0" : "=m"(mxcsr));
+  asm volatile("fnstcw %0" : "=m"(fpucw));
+  frame[0] = (uint64_t)mxcsr | ((uint64_t)fpucw << 32);
+  frame[1] = 0; //r15
+  frame[2] = 0; //r14
+  frame[3] = 0; //r13
+  frame[4] = (uint64_t)(uintptr_t)f; //r12, argument of the trampoline
+  frame[5] = 0; //rbx
+  frame[6] = 0; //rbp
+  frame[7] = (uint64_t)(uintptr_t)&fiber_trampoline;
+  f->sp = frame;
+}
+
+static void switch_stack(Fiber* from, Fiber* to) {
+  fiber_switch(&from->sp,to->sp);
+}
+#else
+#include <ucontext.h>
+
+//Portable fallback, swapcontext also saves the signal mask so it is slower
+static void ucontext_entry(unsigned int high, unsigned int low) {
+  fiber_start((Fiber*)(((uintptr_t)high << 32) | (uintptr_t)low));
+}
+
+static void prepare_stack(Fiber* f) {
+  ucontext_t* uc = new ucontext_t();
+  getcontext(uc);
+  uc->uc_stack.ss_sp = f->stack;
+  uc->uc_stack.ss_size = f->size;
+  uc->uc_link = nullptr;
+  uintptr_t self = (uintptr_t)f;
+  makecontext(uc,(void (*)())&ucontext_entry,2,(unsigned int)(self >> 32),(unsigned int)self);
+  f->context = uc;
+}
+
+static void switch_stack(Fiber* from, Fiber* to) {
+  if (!from->context) {
+    from->context = new ucontext_t();
+  }
+  swapcontext((ucontext_t*)from->context,(ucontext_t*)to->context);
+}
+#endif
+
+//New loop fibers start here and never return
+void fiber_start(Fiber* f) {
+  f->owner->loop(f->owner->arg);
+  assert(0 && "Fiber loop returned");
+  abort();
+}
+
+/*==================================Stacks==================================*/
+static thread_local FiberScheduler* local_scheduler = nullptr; //attached on this thread
+static thread_local char* thread_stack = nullptr; //lowest usable byte of the thread's own stack
+static thread_local char* alternate_stack = nullptr;
+static thread_local bool sized_stack = false; //the thread runs on a stack of the configured size
+static struct sigaction previous_action;
+static char overflow_message[160];
+static size_t overflow_length = 0;
+static const char thread_message[] = "Fork runtime: stack overflow on a thread that is not a worker, raise ulimit -s\n";
+
+char* map_stack(const size_t size) {
+  void* memory = mmap(nullptr,size + FIBER_GUARD_SIZE,PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_STACK,-1,0);
+  if (memory == MAP_FAILED) {
+    return nullptr;
+  }
+  mprotect(memory,FIBER_GUARD_SIZE,PROT_NONE);
+  return (char*)memory + FIBER_GUARD_SIZE;
+}
+
+void unmap_stack(char* stack, const size_t size) {
+  munmap(stack - FIBER_GUARD_SIZE,size + FIBER_GUARD_SIZE);
+}
+
+static bool in_guard(const char* address, const char* stack) {
+  return stack && address < stack && address >= stack - FIBER_GUARD_SIZE;
+}
+
+//Runs on the alternate stack, only async-signal-safe calls
+//Anything but an overflow goes back to the previous handler, the fault repeats once we return
+static void overflow_handler(int signal, siginfo_t* info, void* context) {
+  const char* address = (const char*)info->si_addr;
+  Fiber* f = local_scheduler ? local_scheduler->running() : nullptr;
+  bool fiber = f && f->stack;
+  if (in_guard(address,fiber ? f->stack : thread_stack)) {
+    ssize_t written = (fiber || sized_stack) ? write(STDERR_FILENO,overflow_message,overflow_length)
+                                             : write(STDERR_FILENO,thread_message,sizeof(thread_message) - 1);
+    (void)written;
+    struct sigaction fallback;
+    memset(&fallback,0,sizeof(fallback));
+    fallback.sa_handler = SIG_DFL;
+    sigaction(SIGSEGV,&fallback,nullptr);
+    return;
+  }
+  sigaction(SIGSEGV,&previous_action,nullptr);
+}
+
+void watch_stack_overflow(const size_t size, const bool sized) {
+  static std::once_flag installed;
+  std::call_once(installed,[size]() {
+    overflow_length = snprintf(overflow_message,sizeof(overflow_message),
+      "Fork runtime: stack overflow in a forked statement, stacks are %d MB, raise FORK_STACK_MB\n",
+      (int)(size/(1024*1024)));
+    overflow_length = std::min(overflow_length,sizeof(overflow_message) - 1);
+    struct sigaction action;
+    memset(&action,0,sizeof(action));
+    action.sa_sigaction = &overflow_handler;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV,&action,&previous_action);
+  });
+  sized_stack = sized;
+  pthread_attr_t attr;
+  if (!thread_stack && !pthread_getattr_np(pthread_self(),&attr)) {
+    void* low = nullptr;
+    size_t length = 0;
+    pthread_attr_getstack(&attr,&low,&length);
+    pthread_attr_destroy(&attr);
+    thread_stack = (char*)low;
+  }
+  if (!alternate_stack) {
+    void* memory = mmap(nullptr,FIBER_GUARD_SIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if (memory == MAP_FAILED) {
+      return;
+    }
+    alternate_stack = (char*)memory;
+    stack_t alternate;
+    alternate.ss_sp = alternate_stack;
+    alternate.ss_size = FIBER_GUARD_SIZE;
+    alternate.ss_flags = 0;
+    sigaltstack(&alternate,nullptr);
+  }
+}
+
+//Before a worker thread exits, its alternate stack goes with it
+void unwatch_stack_overflow() {
+  if (!alternate_stack) {
+    return;
+  }
+  stack_t disabled;
+  memset(&disabled,0,sizeof(disabled));
+  disabled.ss_flags = SS_DISABLE;
+  sigaltstack(&disabled,nullptr);
+  munmap(alternate_stack,FIBER_GUARD_SIZE);
+  alternate_stack = nullptr;
+  thread_stack = nullptr;
+}
+
+/*==================================Fiber===================================*/
+Fiber::Fiber(FiberScheduler* owner, const size_t size) {
+  this->owner = owner;
+  this->size = size;
+  sp = nullptr;
+  stack = nullptr;
+  context = nullptr;
+  tsan = nullptr;
+  queued.store(false);
+  exiting = false;
+  if (size) {
+    stack = map_stack(size);
+    assert(stack && "Unable to map fiber stack");
+    prepare_stack(this);
+#ifdef FIBER_TSAN
+    tsan = __tsan_create_fiber(0);
+#endif
+  }
+}
+
+Fiber::~Fiber() {
+  if (stack) {
+    unmap_stack(stack,size);
+#ifdef FIBER_TSAN
+    __tsan_destroy_fiber(tsan);
+#endif
+  }
+#if !defined(__x86_64__)
+  delete (ucontext_t*)context;
+#endif
+}
+
+/*==============================FiberScheduler==============================*/
+bool FiberScheduler::TimerOrder::operator()(const Timer& a, const Timer& b) const {
+  return a.first > b.first; //earliest deadline on top
+}
+
+FiberScheduler::FiberScheduler(void (*loop)(void*), void* arg, const size_t stackSize) {
+  this->loop = loop;
+  this->arg = arg;
+  this->stackSize = stackSize;
+  suspended = 0;
+  readyCount.store(0);
+  root = new Fiber(this,0);
+  current = root;
+}
+
+FiberScheduler::~FiberScheduler() {
+  for (auto it = fibers.begin(), end = fibers.end(); it != end; ++it) {
+    delete *it;
+  }
+  delete root;
+}
+
+//Adopt the calling thread's stack as the root fiber
+void FiberScheduler::attach() {
+  local_scheduler = this;
+  current = root;
+  root->exiting = false;
+#ifdef FIBER_TSAN
+  root->tsan = __tsan_get_current_fiber();
+#endif
+}
+
+Fiber* FiberScheduler::running() const {
+  return current;
+}
+
+Fiber* FiberScheduler::getRoot() const {
+  return root;
+}
+
+//Any thread, a fiber is queued at most once until it is resumed
+void FiberScheduler::wake(Fiber* f) {
+  if (f->queued.exchange(true)) {
+    return;
+  }
+  std::lock_guard<std::mutex> section_monitor(readyMutex);
+  ready.push_back(f);
+  readyCount.fetch_add(1);
+}
+
+Fiber* FiberScheduler::popReady() {
+  if (!readyCount.load()) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> section_monitor(readyMutex);
+  if (ready.empty()) {
+    return nullptr;
+  }
+  Fiber* f = ready.front();
+  ready.pop_front();
+  readyCount.fetch_sub(1);
+  f->queued.store(false);
+  return f;
+}
+
+bool FiberScheduler::hasReady() const {
+  return readyCount.load() > 0;
+}
+
+//Only touches scheduler state, the fiber that resumes here may be running on a new thread
+void FiberScheduler::switchTo(Fiber* next) {
+  Fiber* prev = current;
+  if (next == prev) {
+    return;
+  }
+  current = next;
+#ifdef FIBER_TSAN
+  __tsan_switch_to_fiber(next->tsan,0);
+#endif
+  switch_stack(prev,next);
+}
+
+//An idle loop fiber, or a new one when all of them are busy
+Fiber* FiberScheduler::loopFiber() {
+  if (!idleFibers.empty()) {
+    Fiber* f = idleFibers.back();
+    idleFibers.pop_back();
+    return f;
+  }
+  Fiber* f = new Fiber(this,stackSize);
+  fibers.push_back(f);
+  return f;
+}
+
+void FiberScheduler::idle(Fiber* f) {
+  idleFibers.push_back(f);
+}
+
+void FiberScheduler::unidle(Fiber* f) {
+  for (auto it = idleFibers.begin(), end = idleFibers.end(); it != end; ++it) {
+    if (*it == f) {
+      idleFibers.erase(it);
+      return;
+    }
+  }
+}
+
+void FiberScheduler::addTimer(const std::chrono::steady_clock::time_point deadline, Fiber* f) {
+  timers.push(std::make_pair(deadline,f));
+}
+
+//Wake every fiber whose deadline passed, true if any was woken
+bool FiberScheduler::pollTimers() {
+  if (timers.empty()) {
+    return false;
+  }
+  auto now = std::chrono::steady_clock::now();
+  bool woken = false;
+  while (!timers.empty() && timers.top().first <= now) {
+    wake(timers.top().second);
+    timers.pop();
+    woken = true;
+  }
+  return woken;
+}
+
+bool FiberScheduler::hasTimers() const {
+  return !timers.empty();
+}
+
+std::chrono::steady_clock::time_point FiberScheduler::nextTimer() const {
+  return timers.top().first;
+}
@@ -0,0 +1,89 @@
+//Stackful fibers that forked statements run on
+
+//DO NOT USE GC HERE --- not compatible with C++11 <thread>
+
+#ifndef __FIBER_H
+#define __FIBER_H
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <queue>
+#include <deque>
+#include <chrono>
+#include <stdint.h>
+#include <stddef.h>
+
+//Default virtual size of fiber and worker stacks, same as a default thread stack
+//  pages are only committed when touched
+#define FIBER_STACK_SIZE (8*1024*1024)
+//Inaccessible pages below every stack, an overflow faults here instead of corrupting a neighbour
+#define FIBER_GUARD_SIZE (64*1024)
+
+class FiberScheduler;
+
+//Stack of size usable bytes above a guard, reserved without committing memory, nullptr on failure
+char* map_stack(const size_t size);
+void unmap_stack(char* stack, const size_t size);
+//Report a stack overflow of the calling thread or its fibers by name before the crash
+//  the handler is installed once with the stack size it names, each thread adds an alternate signal stack
+//  sized is false for threads on their own stack (Ex: main), their overflow points at ulimit -s instead
+void watch_stack_overflow(const size_t size, const bool sized);
+void unwatch_stack_overflow();
+
+//A fiber never leaves the thread of its scheduler, so thread locals stay valid across switches
+class Fiber {
+public:
+	Fiber(FiberScheduler* owner, const size_t size);
+	~Fiber();
+	void* sp; //saved stack pointer while switched out
+	char* stack; //nullptr for a thread's own stack
+	size_t size;
+	FiberScheduler* owner;
+	std::atomic<bool> queued; //already in the ready queue
+	bool exiting; //root fiber of a worker that is leaving its loop
+	void* context; //saved ucontext where there is no assembly switch
+	void* tsan; //thread sanitizer fiber handle
+};
+
+//Per-thread set of fibers: the running one, those ready to resume, idle loop fibers and timers
+//Only the owning thread switches fibers, any thread may wake one
+class FiberScheduler {
+public:
+	FiberScheduler(void (*loop)(void*), void* arg, const size_t stackSize);
+	~FiberScheduler();
+	void attach();
+	Fiber* running() const;
+	Fiber* getRoot() const;
+	void wake(Fiber* f);
+	Fiber* popReady();
+	bool hasReady() const;
+	void switchTo(Fiber* next);
+	Fiber* loopFiber();
+	void idle(Fiber* f);
+	void unidle(Fiber* f);
+	void addTimer(const std::chrono::steady_clock::time_point deadline, Fiber* f);
+	bool pollTimers();
+	bool hasTimers() const;
+	std::chrono::steady_clock::time_point nextTimer() const;
+	int64_t suspended; //fibers waiting on a statement or a timer
+private:
+	typedef std::pair<std::chrono::steady_clock::time_point,Fiber*> Timer;
+	struct TimerOrder {
+		bool operator()(const Timer& a, const Timer& b) const;
+	};
+	void (*loop)(void*); //every new loop fiber runs loop(arg), it never returns
+	void* arg;
+	size_t stackSize; //of every loop fiber
+	Fiber* current;
+	Fiber* root;
+	std::mutex readyMutex;
+	std::deque<Fiber*> ready;
+	std::atomic<int64_t> readyCount;
+	std::vector<Fiber*> idleFibers;
+	std::vector<Fiber*> fibers; //every fiber with its own stack, freed with the scheduler
+	std::priority_queue<Timer,std::vector<Timer>,TimerOrder> timers;
+	friend void fiber_start(Fiber* f);
+};
+
+#endif /* __FIBER_H */
@@ -12,6 +12,17 @@ std::mutex malloc_mutex;
 //Parallism manager
 ParContextManager manager;
 
+//FORK_SERVE=[host:]port turns this process into a worker of a FORK_REMOTE coordinator
+//  constructed after the manager, so statements that fork run on this process's pool, main never runs
+static struct RemoteWorker {
+  RemoteWorker() {
+    const char* address = getenv("FORK_SERVE");
+    if (address) {
+      RemoteBackend::serve(address);
+    }
+  }
+} remote_worker;
+
 //Public-facing standard library functions
 //Note that cmath functions (Ex: sin, cos) are available as well
 
@@ -68,14 +79,42 @@ extern "C" void free_int(int64_t* i) {
 }
 
 extern "C" void do_work_ms(int64_t i) {
-  std::this_thread::sleep_for(std::chrono::milliseconds(i));
+  if (!manager.sleep_ms(i)) { //only the fiber waits, its thread keeps running statements
+    manager.enter_blocking(); //the thread waits, another worker takes its place
+    std::this_thread::sleep_for(std::chrono::milliseconds(i));
+    manager.leave_blocking();
+  }
+}
+
+//Limit the number of worker threads, zero restores the detected default
+extern "C" void set_max_threads(int64_t i) {
+  manager.set_max_threads(i);
+}
+
+extern "C" int64_t get_max_threads() {
+  return manager.get_max_threads();
+}
+
+//Number of NUMA nodes the workers are spread over, 1 without NUMA
+extern "C" int64_t get_numa_nodes() {
+  return manager.get_numa_nodes();
+}
+
+//NUMA node of the calling thread
+extern "C" int64_t get_numa_node() {
+  return manager.get_numa_node();
+}
+
+//Usable CPUs of a NUMA node, 0 for an unknown node
+extern "C" int64_t get_node_cpus(int64_t node) {
+  return manager.get_node_cpus(node);
 }
 
 //Hidden funcitons implement parallism
 //They are not intended to be called by user code
 
 // id - zero-indexed number of the statement being scheduled for the commit
-// cid - context identifier obtained from make_context
+// cid - opaque context handle obtained from make_context
 // CAST TO FUNCTION POINTER MUST BE VALID!
 extern "C"  void __fork_sched_int(void* func,void* env,int64_t id,int64_t cid) {
   manager.sched_int((int64_t (*)(void*))func,env,id,cid);
@@ -102,7 +141,7 @@ extern "C"  void __fork_sched_void(void* func,void* env,int64_t id,int64_t cid)
 //  known - original value parameter is valid
 //  id - index of statement being reconned in this commit, starting at zero
 //  max - maximum valid index of statements in this commit
-//  cid - context identifier obtained from make_context
+//  cid - opaque context handle obtained from make_context
 //Conflict resolution scheme: none, always return value of the statement
 //Right now, none of the function parameters are used
 extern "C" int64_t __recon_int(int64_t original,int64_t known,int64_t id,int64_t max,int64_t cid) {
@@ -125,8 +164,37 @@ extern "C" void  __recon_void(int64_t id,int64_t max,int64_t cid) {
   manager.recon_void(id,max,cid);
 }
 
-extern "C" int64_t __make_context() {
-  return manager.make_context();
+//Batched form of the calls above, one call schedules or reconciles a whole commit
+//  descriptors - n statements, descriptors[id] describes the statement with that id
+//  results - n 64-bit entries, float results are stored as their bit pattern
+extern "C" void __fork_sched_group(void* descriptors,int64_t n,int64_t cid) {
+  manager.sched_group((StatementDescriptor*)descriptors,n,cid);
+}
+
+extern "C" void __recon_group(int64_t* results,int64_t n,int64_t cid) {
+  manager.recon_group(results,n,cid);
+}
+
+//Speculative if statement, statement 0 sets *taken, the branch it did not pick is cancelled
+//  returns whether the then branch was taken
+extern "C" int64_t __recon_branch(int64_t* results,int64_t n,int64_t* taken,int64_t cid) {
+  return manager.recon_branch(results,n,taken,cid);
+}
+
+//Stores and loads through pointers in every function, emitted when FORK_TRANSACTIONS is set
+//  inside a transactional statement stores are buffered until recon, elsewhere both are plain accesses
+extern "C" void __tx_store(int64_t* address,int64_t value) {
+  manager.tx_store(address,value);
+}
+
+extern "C" int64_t __tx_load(int64_t* address) {
+  return manager.tx_load(address);
+}
+
+//Prepare a context for one commit
+//  max - number of statements that will be scheduled in this commit
+extern "C" int64_t __make_context(int64_t max) {
+  return manager.make_context(max);
 }
 
 extern "C" void __destroy_context(int64_t cid) {
@@ -27,6 +27,16 @@ extern "C" void free_float(float* f);
 
 extern "C" void free_int(int64_t* i);
 
+extern "C" void set_max_threads(int64_t i);
+
+extern "C" int64_t get_max_threads();
+
+extern "C" int64_t get_numa_nodes();
+
+extern "C" int64_t get_numa_node();
+
+extern "C" int64_t get_node_cpus(int64_t node);
+
 extern "C"  void __fork_sched_int(void* func,void* env,int64_t id,int64_t cid);
 
 extern "C"  void __fork_sched_float(void* func,void* end,int64_t id,int64_t cid);
@@ -47,7 +57,15 @@ extern "C" double* __recon_floatptr(double* original,int64_t known,int64_t id,in
 
 extern "C" void __recon_void(int64_t id,int64_t max,int64_t cid);
 
-extern "C" int64_t __make_context();
+extern "C" void __fork_sched_group(void* descriptors,int64_t n,int64_t cid);
+
+extern "C" void __recon_group(int64_t* results,int64_t n,int64_t cid);
+
+extern "C" void __tx_store(int64_t* address,int64_t value);
+
+extern "C" int64_t __tx_load(int64_t* address);
+
+extern "C" int64_t __make_context(int64_t max);
 
 extern "C" void __destroy_context(int64_t cid);
 
@@ -42,6 +42,22 @@ Expression* Expression::acceptVisitor(LambdaReconVisitor* v) {
 	return v->visitExpression(this);
 }
 
+bool Expression::references(const char* name) const {
+	return true;
+}
+
+bool Expression::addresses(const char* name) const {
+	return false;
+}
+
+bool Expression::pure() const {
+	return false;
+}
+
+bool Expression::designates(const char* name) const {
+	return false;
+}
+
 /*================================Statement=================================*/
 Statement::Statement() {
 	this->commit = false;
@@ -59,6 +75,26 @@ bool Statement::lambdable() const {
 	return false;
 }
 
+bool Statement::enclosable() const {
+	return true;
+}
+
+bool Statement::assigns(const char* name) const {
+	return false;
+}
+
+bool Statement::references(const char* name) const {
+	return true;
+}
+
+bool Statement::addresses(const char* name) const {
+	return true;
+}
+
+bool Statement::pure() const {
+	return false;
+}
+
 void Statement::describe() const {
 	printf("---Found generic statement object with no fields\n");
 }
@@ -90,6 +126,14 @@ llvm::Value* Integer::acceptVisitor(ASTVisitor* v) {
 	return v->visitInteger(this);
 }
 
+bool Integer::references(const char* name) const {
+	return false;
+}
+
+bool Integer::pure() const {
+	return true;
+}
+
 /*==================================Float===================================*/
 Float::Float(double value) {
 	this->value = value;
@@ -105,6 +149,14 @@ llvm::Value* Float::acceptVisitor(ASTVisitor* v) {
 	return v->visitFloat(this);
 }
 
+bool Float::references(const char* name) const {
+	return false;
+}
+
+bool Float::pure() const {
+	return true;
+}
+
 /*================================Identifier================================*/
 Identifier::Identifier(char* name) {
 	this->name = dup_char(name);
@@ -120,6 +172,22 @@ llvm::Value* Identifier::acceptVisitor(ASTVisitor* v) {
 	return v->visitIdentifier(this);
 }
 
+Expression* Identifier::acceptVisitor(LambdaReconVisitor* v) {
+	return v->visitIdentifier(this);
+}
+
+bool Identifier::references(const char* name) const {
+	return !strcmp(this->name, name);
+}
+
+bool Identifier::pure() const {
+	return true;
+}
+
+bool Identifier::designates(const char* name) const {
+	return !strcmp(this->name, name);
+}
+
 /*==============================UnaryOperator===============================*/
 UnaryOperator::UnaryOperator(char* op, Expression* exp) {
 	this->op = dup_char(op);
@@ -136,6 +204,18 @@ llvm::Value* UnaryOperator::acceptVisitor(ASTVisitor* v) {
 	return v->visitUnaryOperator(this);
 }
 
+bool UnaryOperator::references(const char* name) const {
+	return exp->references(name);
+}
+
+bool UnaryOperator::addresses(const char* name) const {
+	return exp->addresses(name);
+}
+
+bool UnaryOperator::pure() const {
+	return exp->pure();
+}
+
 /*==============================BinaryOperator==============================*/
 BinaryOperator::BinaryOperator(Expression* left, char* op, Expression* right) {
     this->op = dup_char(op);
@@ -153,6 +233,22 @@ llvm::Value* BinaryOperator::acceptVisitor(ASTVisitor* v) {
 	return v->visitBinaryOperator(this);
 }
 
+Expression* BinaryOperator::acceptVisitor(LambdaReconVisitor* v) {
+	return v->visitBinaryOperator(this);
+}
+
+bool BinaryOperator::references(const char* name) const {
+	return left->references(name) || right->references(name);
+}
+
+bool BinaryOperator::addresses(const char* name) const {
+	return left->addresses(name) || right->addresses(name);
+}
+
+bool BinaryOperator::pure() const {
+	return strcmp(op, "/") && left->pure() && right->pure(); //integer division by zero traps
+}
+
 /*==================================Block===================================*/
 Block::Block(std::vector<Statement*, gc_allocator<Statement*>>* statements) {
 	this->statements = statements;
@@ -168,6 +264,61 @@ Block::Block() {
 	this->statements = nullptr;
 }
 
+bool Block::enclosable() const {
+	if(statements) {
+		for(auto it = statements->begin(), end = statements->end(); it != end; ++it) {
+			if(!(*it)->enclosable()) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool Block::assigns(const char* name) const {
+	if(statements) {
+		for(auto it = statements->begin(), end = statements->end(); it != end; ++it) {
+			if((*it)->assigns(name)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool Block::references(const char* name) const {
+	if(statements) {
+		for(auto it = statements->begin(), end = statements->end(); it != end; ++it) {
+			if((*it)->references(name)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool Block::addresses(const char* name) const {
+	if(statements) {
+		for(auto it = statements->begin(), end = statements->end(); it != end; ++it) {
+			if((*it)->addresses(name)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool Block::pure() const {
+	if(statements) {
+		for(auto it = statements->begin(), end = statements->end(); it != end; ++it) {
+			if(!(*it)->pure() || !(*it)->enclosable()) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
 llvm::Value* Block::acceptVisitor(ASTVisitor* v) {
 	return v->visitBlock(this);
 }
@@ -192,6 +343,28 @@ llvm::Value* FunctionCall::acceptVisitor(ASTVisitor* v) {
 	return v->visitFunctionCall(this);
 }
 
+Expression* FunctionCall::acceptVisitor(LambdaReconVisitor* v) {
+	return v->visitFunctionCall(this);
+}
+
+bool FunctionCall::references(const char* name) const {
+	for(auto it = args->begin(), end = args->end(); it != end; ++it) {
+		if((*it)->references(name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool FunctionCall::addresses(const char* name) const {
+	for(auto it = args->begin(), end = args->end(); it != end; ++it) {
+		if((*it)->addresses(name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 /*=================================NullLiteral==================================*/
 NullLiteral::NullLiteral() { }
 
@@ -205,6 +378,14 @@ llvm::Value* NullLiteral::acceptVisitor(ASTVisitor* v) {
 	return v->visitNullLiteral(this);
 }
 
+bool NullLiteral::references(const char* name) const {
+	return false;
+}
+
+bool NullLiteral::pure() const {
+	return true;
+}
+
 /*=================================Keyword==================================*/
 Keyword::Keyword(char* name) {
 	this->name = dup_char(name);
@@ -245,6 +426,22 @@ bool VariableDefinition::lambdable() const {
 	return !(!exp);
 }
 
+bool VariableDefinition::assigns(const char* name) const {
+	return !strcmp(ident->name, name);
+}
+
+bool VariableDefinition::references(const char* name) const {
+	return assigns(name) || (exp && exp->references(name));
+}
+
+bool VariableDefinition::addresses(const char* name) const {
+	return exp && exp->addresses(name);
+}
+
+bool VariableDefinition::pure() const {
+	return !exp || exp->pure();
+}
+
 const char* VariableDefinition::stringType() const {
 	return type->name;
 }
@@ -265,6 +462,10 @@ llvm::Value* VariableDefinition::acceptVisitor(ASTVisitor* v) {
 	return v->visitVariableDefinition(this);
 }
 
+Expression* VariableDefinition::acceptVisitor(LambdaReconVisitor* v) {
+	return v->visitVariableDefinition(this);
+}
+
 void VariableDefinition::acceptVisitor(StatementVisitor* v) {
 	v->visitVariableDefinition(this);
 }
@@ -287,6 +488,10 @@ bool StructureDefinition::lambdable() const {
 	return false;
 }
 
+bool StructureDefinition::enclosable() const {
+	return false; //struct types belong to the main module
+}
+
 std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>> StructureDefinition::getVariables() const {
 	StatementVisitor* sv = new StatementVisitor();
 	block->acceptVisitor(sv);
@@ -333,6 +538,7 @@ FunctionDefinition::FunctionDefinition(Keyword* type, Identifier* ident,
 	this->args = args;
 	this->block = block;
 	this->hasPointerType = hasPointerType;
+	this->async = false;
 	assert(type && "Missing return type");
 }
 
@@ -345,6 +551,7 @@ FunctionDefinition::FunctionDefinition(Identifier* user_type, Identifier* ident,
 	this->args = args;
 	this->block = block;
 	this->hasPointerType = hasPointerType;
+	this->async = false;
 	assert(user_type && "Missing user-defined return type");
 }
 
@@ -360,6 +567,10 @@ bool FunctionDefinition::lambdable() const {
 	return false;
 }
 
+bool FunctionDefinition::enclosable() const {
+	return false;
+}
+
 void FunctionDefinition::describe() const {
 	#ifdef YYDEBUG
 	printf("---Found Function Definition: %s\n",ident->name);
@@ -431,6 +642,18 @@ bool ExpressionStatement::lambdable() const {
 	return true;
 }
 
+bool ExpressionStatement::references(const char* name) const {
+	return exp->references(name);
+}
+
+bool ExpressionStatement::addresses(const char* name) const {
+	return exp->addresses(name);
+}
+
+bool ExpressionStatement::pure() const {
+	return exp->pure();
+}
+
 void ExpressionStatement::describe() const {
 	#ifdef YYDEBUG
 	printf("---Expression(s) converted into statements\n");
@@ -441,6 +664,49 @@ llvm::Value* ExpressionStatement::acceptVisitor(ASTVisitor* v) {
 	return v->visitExpressionStatement(this);
 }
 
+Expression* ExpressionStatement::acceptVisitor(LambdaReconVisitor* v) {
+	return v->visitExpressionStatement(this);
+}
+
+/*=============================BlockStatement===============================*/
+BlockStatement::BlockStatement(Block* block) {
+	this->block = block;
+}
+
+bool BlockStatement::lambdable() const {
+	return enclosable();
+}
+
+bool BlockStatement::enclosable() const {
+	return block->enclosable();
+}
+
+bool BlockStatement::assigns(const char* name) const {
+	return block->assigns(name);
+}
+
+bool BlockStatement::references(const char* name) const {
+	return block->references(name);
+}
+
+bool BlockStatement::addresses(const char* name) const {
+	return block->addresses(name);
+}
+
+bool BlockStatement::pure() const {
+	return block->pure();
+}
+
+void BlockStatement::describe() const {
+	#ifdef YYDEBUG
+	printf("---Found Block Statement\n");
+	#endif
+}
+
+llvm::Value* BlockStatement::acceptVisitor(ASTVisitor* v) {
+	return v->visitBlockStatement(this);
+}
+
 /*=============================ReturnStatement==============================*/
 ReturnStatement::ReturnStatement(Expression* exp) {
 	this->exp = exp;
@@ -458,6 +724,18 @@ bool ReturnStatement::lambdable() const {
 	return false;
 }
 
+bool ReturnStatement::enclosable() const {
+	return false; //would return from the lambda instead of the function
+}
+
+bool ReturnStatement::references(const char* name) const {
+	return exp && exp->references(name);
+}
+
+bool ReturnStatement::addresses(const char* name) const {
+	return exp && exp->addresses(name);
+}
+
 void ReturnStatement::describe() const {
 	#ifdef YYDEBUG
 	if (exp) {
@@ -488,6 +766,22 @@ bool AssignStatement::lambdable() const {
 	return true;
 }
 
+bool AssignStatement::assigns(const char* name) const {
+	return target->designates(name);
+}
+
+bool AssignStatement::references(const char* name) const {
+	return target->references(name) || valxp->references(name);
+}
+
+bool AssignStatement::addresses(const char* name) const {
+	return target->addresses(name) || valxp->addresses(name);
+}
+
+bool AssignStatement::pure() const {
+	return target->pure() && valxp->pure();
+}
+
 llvm::Value* AssignStatement::acceptVisitor(ASTVisitor* v) {
 	return v->visitAssignStatement(this);
 }
@@ -512,7 +806,27 @@ bool IfStatement::statementCommits() const {
 }
 
 bool IfStatement::lambdable() const {
-	return false;
+	return enclosable();
+}
+
+bool IfStatement::enclosable() const {
+	return (!block || block->enclosable()) && (!else_block || else_block->enclosable());
+}
+
+bool IfStatement::assigns(const char* name) const {
+	return (block && block->assigns(name)) || (else_block && else_block->assigns(name));
+}
+
+bool IfStatement::references(const char* name) const {
+	return exp->references(name) || (block && block->references(name)) || (else_block && else_block->references(name));
+}
+
+bool IfStatement::addresses(const char* name) const {
+	return exp->addresses(name) || (block && block->addresses(name)) || (else_block && else_block->addresses(name));
+}
+
+bool IfStatement::pure() const {
+	return exp->pure() && (!block || block->pure()) && (!else_block || else_block->pure());
 }
 
 void IfStatement::describe() const {
@@ -525,6 +839,10 @@ llvm::Value* IfStatement::acceptVisitor(ASTVisitor* v) {
 	return v->visitIfStatement(this);
 }
 
+Expression* IfStatement::acceptVisitor(LambdaReconVisitor* v) {
+	return v->visitIfStatement(this);
+}
+
 /*===============================ExternStatement================================*/
 ExternStatement::ExternStatement(Keyword* type,Identifier* ident,
           std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>* args, bool hasPointerType) :
@@ -554,6 +872,10 @@ bool ExternStatement::lambdable() const {
 	return false;
 }
 
+bool ExternStatement::enclosable() const {
+	return false;
+}
+
 void ExternStatement::describe() const {
 	#ifdef YYDEBUG
 	printf("---Found extern: %s\n",ident->name);
@@ -603,6 +925,14 @@ llvm::Value* PointerExpression::acceptVisitor(ASTVisitor* v) {
 	return v->visitPointerExpression(this);
 }
 
+bool PointerExpression::references(const char* name) const {
+	return ident->references(name) || (offsetExpression && offsetExpression->references(name));
+}
+
+bool PointerExpression::addresses(const char* name) const {
+	return offsetExpression && offsetExpression->addresses(name);
+}
+
 /*===============================AddressOfExpression================================*/
 AddressOfExpression::AddressOfExpression(Identifier* ident,Expression* offsetExpression) {
 	this->ident = ident;
@@ -620,6 +950,17 @@ llvm::Value* AddressOfExpression::acceptVisitor(ASTVisitor* v) {
 	return v->visitAddressOfExpression(this);
 }
 
+bool AddressOfExpression::references(const char* name) const {
+	return ident->references(name) || (offsetExpression && offsetExpression->references(name));
+}
+
+bool AddressOfExpression::addresses(const char* name) const {
+	if(offsetExpression) { //address of an element the pointer variable points to
+		return offsetExpression->addresses(name);
+	}
+	return ident->designates(name);
+}
+
 /*===============================StructureExpression================================*/
 StructureExpression::StructureExpression(Identifier* ident,Identifier* field) {
 	this->ident = ident;
@@ -637,3 +978,11 @@ void StructureExpression::describe() const {
 llvm::Value* StructureExpression::acceptVisitor(ASTVisitor* v) {
 	return v->visitStructureExpression(this);
 }
+
+bool StructureExpression::references(const char* name) const {
+	return ident->references(name);
+}
+
+bool StructureExpression::designates(const char* name) const {
+	return ident->designates(name);
+}
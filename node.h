@@ -55,6 +55,7 @@ class ExpressionStatement;
 class ReturnStatement;
 class AssignStatement;
 class IfStatement;
+class BlockStatement;
 class ASTVisitor;
 class StatementVisitor;
 class CodeGenVisitor;
@@ -81,6 +82,10 @@ public:
 class Expression : public Node {
 public:
 	virtual void describe() const;
+	virtual bool references(const char* name) const; //may read the variable, true when unsure
+	virtual bool addresses(const char* name) const; //may take the address of the variable itself
+	virtual bool pure() const; //only computes on variables: no calls, no memory behind pointers, no division that may trap
+	virtual bool designates(const char* name) const; //is the variable or one of its fields as an assignment target
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 	virtual Expression* acceptVisitor(LambdaReconVisitor* v);
 };
@@ -93,6 +98,11 @@ public:
 	virtual void setCommit(const bool& commit);
 	virtual bool statementCommits() const;
 	virtual bool lambdable() const;
+	virtual bool enclosable() const; //may run inside the body of a lambda
+	virtual bool assigns(const char* name) const; //may assign the variable itself, not memory it points to
+	virtual bool references(const char* name) const; //may read or write the variable, true when unsure
+	virtual bool addresses(const char* name) const; //may take the address of the variable itself, true when unsure
+	virtual bool pure() const; //has no effect but on variables and cannot trap, false when unsure
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 	virtual void acceptVisitor(StatementVisitor* v);
 	virtual Expression* acceptVisitor(LambdaReconVisitor* v);
@@ -106,6 +116,8 @@ public:
 	int64_t value;
 	Integer(int64_t value);
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool pure() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
 
@@ -115,6 +127,8 @@ public:
 	double value;
 	Float(double value);
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool pure() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
 
@@ -124,7 +138,11 @@ public:
 	char* name;
 	Identifier(char* name);
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool pure() const;
+	virtual bool designates(const char* name) const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
+	virtual Expression* acceptVisitor(LambdaReconVisitor* v);
 };
 
 /*==============================UnaryOperator===============================*/
@@ -134,6 +152,9 @@ public:
 	Expression* exp;
 	UnaryOperator(char* op, Expression* exp);
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
+	virtual bool pure() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
 
@@ -145,7 +166,11 @@ public:
 	Expression* right;
 	BinaryOperator(Expression* left, char* op, Expression* right);
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
+	virtual bool pure() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
+	virtual Expression* acceptVisitor(LambdaReconVisitor* v);
 };
 
 /*==================================Block===================================*/
@@ -156,6 +181,11 @@ public:
 	Block();
 	Block(std::vector<Statement*,gc_allocator<Statement*>>* statements);
 	std::vector<Statement*,gc_allocator<Statement*>>* statements;
+	bool enclosable() const;
+	bool assigns(const char* name) const;
+	bool references(const char* name) const;
+	bool addresses(const char* name) const;
+	bool pure() const;
 	virtual void describe() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 	virtual void acceptVisitor(StatementVisitor* v);
@@ -168,7 +198,10 @@ public:
 	std::vector<Expression*,gc_allocator<Expression*>>* args;
 	FunctionCall(Identifier* ident, std::vector<Expression*, gc_allocator<Expression*>>* args);
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
+	virtual Expression* acceptVisitor(LambdaReconVisitor* v);
 };
 
 /*===============================NullLiteral===============================*/
@@ -176,6 +209,8 @@ class NullLiteral : public Expression {
 public:
 	NullLiteral();
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool pure() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
 
@@ -200,9 +235,14 @@ public:
 	VariableDefinition(Keyword* type, Identifier* ident, Expression* exp, bool isPointer);
 	virtual bool statementCommits() const;
 	virtual bool lambdable() const;
+	virtual bool assigns(const char* name) const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
+	virtual bool pure() const;
 	virtual const char* stringType() const;
 	virtual void describe() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
+	virtual Expression* acceptVisitor(LambdaReconVisitor* v);
 	virtual void acceptVisitor(StatementVisitor* v);
 };
 
@@ -218,6 +258,7 @@ public:
 	virtual void setCommit(const bool& commit);
 	virtual bool statementCommits() const;
 	virtual bool lambdable() const;
+	virtual bool enclosable() const;
 	virtual void describe() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 	virtual void acceptVisitor(StatementVisitor* v);
@@ -232,6 +273,7 @@ public:
 	std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>* args;
 	Block* block;
 	bool hasPointerType;
+	bool async; //calls schedule the body and leave a future
 	FunctionDefinition(Keyword* type, Identifier* ident, std::vector<VariableDefinition*,
 		gc_allocator<VariableDefinition*>>* args,
 	Block* block, bool hasPointerType);
@@ -241,6 +283,7 @@ public:
 	virtual void setCommit(const bool& commit);
 	virtual bool statementCommits() const;
 	virtual bool lambdable() const;
+	virtual bool enclosable() const;
 	bool validate() const;
 	virtual void describe() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
@@ -270,6 +313,26 @@ public:
 	ExpressionStatement(Expression* exp);
 	virtual void describe() const;
 	virtual bool lambdable() const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
+	virtual bool pure() const;
+	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
+	virtual Expression* acceptVisitor(LambdaReconVisitor* v);
+};
+
+/*=============================BlockStatement===============================*/
+//Braced block in a list of statements, forked as a whole like an if statement
+class BlockStatement : public Statement {
+public:
+	Block* block;
+	BlockStatement(Block* block);
+	virtual bool lambdable() const;
+	virtual bool enclosable() const;
+	virtual bool assigns(const char* name) const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
+	virtual bool pure() const;
+	virtual void describe() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
 
@@ -282,6 +345,9 @@ public:
 	virtual void setCommit(const bool& commit);
 	virtual bool statementCommits() const;
 	virtual bool lambdable() const;
+	virtual bool enclosable() const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
 	virtual void describe() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
@@ -295,6 +361,10 @@ public:
 	AssignStatement(Expression* target,Expression* valxp);
 	virtual void describe() const;
 	virtual bool lambdable() const;
+	virtual bool assigns(const char* name) const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
+	virtual bool pure() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 	virtual Expression* acceptVisitor(LambdaReconVisitor* v);
 };
@@ -310,8 +380,14 @@ public:
 	virtual void setCommit(const bool& commit);
 	virtual bool statementCommits() const;
 	virtual bool lambdable() const;
+	virtual bool enclosable() const;
+	virtual bool assigns(const char* name) const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
+	virtual bool pure() const;
 	virtual void describe() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
+	virtual Expression* acceptVisitor(LambdaReconVisitor* v);
 };
 
 /*===============================ExternStatement================================*/
@@ -329,6 +405,7 @@ public:
 	virtual void setCommit(const bool& commit);
 	virtual bool statementCommits() const;
 	virtual bool lambdable() const;
+	virtual bool enclosable() const;
 	virtual void describe() const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
@@ -354,6 +431,8 @@ public:
 	bool referencingStruct() const;
 	PointerExpression(Identifier* ident, Expression* offsetExpression, Identifier* field);
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
 
@@ -364,6 +443,8 @@ public:
 	Identifier* ident; //Always acting on the direct value of ident
 	AddressOfExpression(Identifier* ident, Expression* offsetExpression);
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool addresses(const char* name) const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
 
@@ -374,6 +455,8 @@ public:
 	Identifier* ident; //structure ident
 	StructureExpression(Identifier* ident,Identifier* field);
 	virtual void describe() const;
+	virtual bool references(const char* name) const;
+	virtual bool designates(const char* name) const;
 	virtual llvm::Value* acceptVisitor(ASTVisitor* v);
 };
 
@@ -2,258 +2,1438 @@
 //Implementation of the parallel statement execution manager
 
 #include "parContextManager.h"
+#include <new>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include <cstring>
+#include <sched.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
 
-StatementContext::StatementContext() {
-  //Do nothing
+static inline void futex_wait(std::atomic<int>* word, const int expected) {
+  syscall(SYS_futex,(int*)word,FUTEX_WAIT_PRIVATE,expected,nullptr,nullptr,0);
+}
+
+static inline void futex_wake_all(std::atomic<int>* word) {
+  syscall(SYS_futex,(int*)word,FUTEX_WAKE_PRIVATE,INT_MAX,nullptr,nullptr,0);
+}
+
+//Tell the core we are in a spin loop, frees pipeline resources for a sibling hyperthread
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield" ::: "memory");
+#endif
+}
+
+//Threads sleep on a futex picked by context address, never inside the context itself,
+//  because the owner may destroy the context as soon as the last READY is visible
+#define PARK_BUCKETS 64
+struct alignas(CACHE_LINE_SIZE) ParkBucket {
+  std::atomic<int> word; //bumped by every finish that found a waiter
+  std::atomic<int> sleeping;
+};
+static ParkBucket park_buckets[PARK_BUCKETS];
+
+static inline ParkBucket& park_bucket(const void* context) {
+  return park_buckets[((uintptr_t)context / CACHE_LINE_SIZE) % PARK_BUCKETS];
+}
+
+static inline int64_t elapsed_ns(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*=================================StatementHistory=================================*/
+static thread_local uint32_t history_tick = 0;
+
+StatementHistory::StatementHistory() {
+  for (int64_t i = 0; i < HISTORY_ENTRIES; ++i) {
+    entries[i].statement.store(nullptr,std::memory_order_relaxed);
+    entries[i].average.store(0,std::memory_order_relaxed);
+  }
+  on = true;
+}
+
+void StatementHistory::enable(const bool on) {
+  this->on = on;
+}
+
+bool StatementHistory::enabled() const {
+  return on;
+}
+
+//Open addressing on the function pointer, a full neighbourhood leaves the statement untracked
+StatementHistory::Entry* StatementHistory::find(void* statement, const bool insert) {
+  uint64_t hash = ((uint64_t)(uintptr_t)statement * 0x9E3779B97F4A7C15ULL) >> (64 - HISTORY_BITS);
+  for (int64_t i = 0; i < HISTORY_PROBES; ++i) {
+    Entry& e = entries[(hash + i) & (HISTORY_ENTRIES - 1)];
+    void* key = e.statement.load(std::memory_order_acquire);
+    if (key == statement) {
+      return &e;
+    }
+    if (!key) {
+      if (!insert) {
+        return nullptr;
+      }
+      if (e.statement.compare_exchange_strong(key,statement,std::memory_order_acq_rel) || key == statement) {
+        return &e;
+      }
+    }
+  }
+  return nullptr;
+}
+
+int64_t StatementHistory::estimate(void* statement) {
+  if (!on) {
+    return -1;
+  }
+  Entry* e = find(statement,false);
+  int64_t average = e ? e->average.load(std::memory_order_relaxed) : 0;
+  return average ? average : -1;
+}
+
+//Unknown and long statements are always timed, short ones only now and then
+bool StatementHistory::sample(void* statement) {
+  if (!on) {
+    return false;
+  }
+  int64_t average = estimate(statement);
+  return average < 0 || average >= HISTORY_SHORT_NS || !(++history_tick % HISTORY_SAMPLE);
+}
+
+//Exponential moving average with weight 1/8 for the new sample
+void StatementHistory::record(void* statement, const int64_t ns) {
+  Entry* e = find(statement,true);
+  if (!e) {
+    return;
+  }
+  int64_t sample = std::max(ns,(int64_t)1);
+  int64_t average = e->average.load(std::memory_order_relaxed);
+  e->average.store(average ? average + (sample - average)/8 : sample,std::memory_order_relaxed);
+}
+
+int64_t StatementHistory::size() const {
+  int64_t used = 0;
+  for (int64_t i = 0; i < HISTORY_ENTRIES; ++i) {
+    used += entries[i].statement.load(std::memory_order_relaxed) != nullptr;
+  }
+  return used;
+}
+
+/*=================================StatementSlot=================================*/
+//Runs the slot and every statement batched behind it
+//The link is read first, a finished slot may be recycled by its waiter
+void StatementSlot::execute() {
+  StatementSlot* s = this;
+  while (s) {
+    StatementSlot* next = s->batch;
+    s->run();
+    s->context->finish(s);
+    s = next;
+  }
+}
+
+void StatementSlot::run() {
+  if (cancelled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  WriteLog* outer = log ? WriteLog::install(log) : nullptr;
+  StatementHistory* history = context->history;
+  bool timed = history->sample(statement);
+  std::chrono::steady_clock::time_point start;
+  if (timed) {
+    start = std::chrono::steady_clock::now();
+  }
+  switch (type) {
+    case SLOT_INT:
+      result.i = ((int64_t (*)(void*))statement)(env);
+      break;
+    case SLOT_FLOAT:
+      result.f = ((double (*)(void*))statement)(env);
+      break;
+    case SLOT_INTPTR:
+      result.ip = ((int64_t* (*)(void*))statement)(env);
+      break;
+    case SLOT_FLOATPTR:
+      result.fp = ((double* (*)(void*))statement)(env);
+      break;
+    case SLOT_VOID:
+      ((void (*)(void*))statement)(env);
+      break;
+  }
+  if (timed) {
+    history->record(statement,std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+  if (log) {
+    WriteLog::install(outer);
+  }
+}
+
+bool StatementSlot::ready() const {
+  return state.load(std::memory_order_acquire) == SLOT_READY;
+}
+
+/*=================================LocalityTable=================================*/
+LocalityTable::LocalityTable() {
+  for (int64_t i = 0; i < LOCALITY_ENTRIES; ++i) {
+    entries[i].store(0,std::memory_order_relaxed);
+  }
+  placed.store(0,std::memory_order_relaxed);
+  kept.store(0,std::memory_order_relaxed);
+  on = true;
+  measure = false;
+}
+
+void LocalityTable::configure(const bool on, const bool measure) {
+  this->on = on;
+  this->measure = measure;
+}
+
+int64_t LocalityTable::key(const int64_t hint, void* statement, const int64_t id) const {
+  if (!on || !hint) {
+    return 0;
+  }
+  uint64_t h = (uint64_t)hint ^ ((uint64_t)(uintptr_t)statement * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)id * 0xC2B2AE3D27D4EB4FULL);
+  h ^= h >> 29;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 32;
+  return (int64_t)(h | ((uint64_t)1 << LOCALITY_SLOT_BITS)); //never 0
+}
+
+int64_t LocalityTable::preferred(const int64_t key) {
+  int64_t tag = key & ~(((int64_t)1 << LOCALITY_SLOT_BITS) - 1);
+  int64_t entry = entries[((uint64_t)key >> (64 - LOCALITY_BITS))].load(std::memory_order_relaxed);
+  if ((entry & ~(((int64_t)1 << LOCALITY_SLOT_BITS) - 1)) != tag) {
+    return -1;
+  }
+  return (entry & (((int64_t)1 << LOCALITY_SLOT_BITS) - 1)) - 1;
+}
+
+//Slot -1 (a thread outside the pool) clears the preference
+void LocalityTable::record(const int64_t key, const int64_t slot, const int64_t home) {
+  int64_t tag = key & ~(((int64_t)1 << LOCALITY_SLOT_BITS) - 1);
+  entries[((uint64_t)key >> (64 - LOCALITY_BITS))].store(tag | (slot + 1),std::memory_order_relaxed);
+  if (measure && home >= 0) {
+    placed.fetch_add(1,std::memory_order_relaxed);
+    kept.fetch_add(slot == home,std::memory_order_relaxed);
+  }
+}
+
+void LocalityTable::report() {
+  printf("Locality: %s, %lld statements placed with their previous worker, %lld ran there\n",on ? "on" : "off",
+         (long long)placed.load(),(long long)kept.load());
+}
+
+/*=================================WaitPolicy=================================*/
+WaitPolicy::WaitPolicy() {
+  recent.store(0,std::memory_order_relaxed);
+  for (int64_t i = 0; i < WAIT_BUCKETS; ++i) {
+    buckets[i].store(0,std::memory_order_relaxed);
+  }
+  for (int64_t i = 0; i < WAIT_OUTCOMES; ++i) {
+    outcomes[i].store(0,std::memory_order_relaxed);
+  }
+  cpus = 1;
+  spin = true;
+  measure = false;
+}
+
+void WaitPolicy::configure(const int64_t cpus, const bool spin, const bool measure) {
+  this->cpus = cpus;
+  this->spin = spin;
+  this->measure = measure;
+}
+
+bool WaitPolicy::timed() const {
+  return measure || (spin && cpus > 1);
+}
+
+//About twice the expected wait, nothing when the statement is long or needs this very CPU
+int64_t WaitPolicy::budget(const int64_t estimate) {
+  if (!spin || cpus <= 1) {
+    return 0;
+  }
+  int64_t expected = (estimate >= 0) ? estimate : recent.load(std::memory_order_relaxed);
+  if (expected <= 0) {
+    expected = WAIT_SPIN_DEFAULT_NS;
+  }
+  return (2*expected > WAIT_SPIN_NS) ? 0 : 2*expected;
+}
+
+void WaitPolicy::completed(const int64_t ns, const WaitOutcome outcome) {
+  if (outcome != WAIT_READY) {
+    int64_t average = recent.load(std::memory_order_relaxed);
+    recent.store(average ? average + (ns - average)/8 : std::max(ns,(int64_t)1),std::memory_order_relaxed);
+  }
+  if (!measure) {
+    return;
+  }
+  int64_t bucket = (ns > 1) ? 63 - __builtin_clzll((uint64_t)ns) : 0;
+  buckets[std::min(bucket,(int64_t)WAIT_BUCKETS - 1)].fetch_add(1,std::memory_order_relaxed);
+  outcomes[outcome].fetch_add(1,std::memory_order_relaxed);
+}
+
+void WaitPolicy::report() {
+  const char* names[] = {"ready","helped","spun","yielded","parked"};
+  printf("Recon waits:");
+  for (int64_t i = 0; i < WAIT_OUTCOMES; ++i) {
+    printf(" %s %lld%s",names[i],(long long)outcomes[i].load(),(i + 1 < WAIT_OUTCOMES) ? "," : "\n");
+  }
+  for (int64_t i = 0; i < WAIT_BUCKETS; ++i) {
+    int64_t waits = buckets[i].load();
+    if (waits) {
+      printf("  < %lld ns: %lld\n",(long long)2 << i,(long long)waits);
+    }
+  }
+}
+
+/*=================================AddressTable=================================*/
+#define ADDRESS_TABLE_MIN 64
+
+AddressTable::AddressTable() {
+  entries.resize(ADDRESS_TABLE_MIN,Entry{nullptr,0});
+  mask = ADDRESS_TABLE_MIN - 1;
+}
+
+void AddressTable::clear() {
+  for (auto it = used.begin(), end = used.end(); it != end; ++it) {
+    entries[*it].address = nullptr;
+  }
+  used.clear();
+}
+
+static inline uint64_t address_hash(const int64_t* address) {
+  return ((uint64_t)(uintptr_t)address >> 3) * 0x9E3779B97F4A7C15ULL;
+}
+
+int64_t* AddressTable::find(const int64_t* address) {
+  for (uint64_t i = address_hash(address) >> 32;; ++i) {
+    Entry& e = entries[i & mask];
+    if (e.address == address) {
+      return &e.value;
+    }
+    if (!e.address) {
+      return nullptr;
+    }
+  }
+}
+
+int64_t* AddressTable::insert(int64_t* address, bool& added) {
+  if ((int64_t)used.size()*2 >= (int64_t)entries.size()) {
+    grow();
+  }
+  for (uint64_t i = address_hash(address) >> 32;; ++i) {
+    Entry& e = entries[i & mask];
+    if (e.address == address) {
+      added = false;
+      return &e.value;
+    }
+    if (!e.address) {
+      e.address = address;
+      used.push_back(i & mask);
+      added = true;
+      return &e.value;
+    }
+  }
+}
+
+//Rehash in insertion order, which used keeps
+void AddressTable::grow() {
+  std::vector<Entry> old(entries.size()*2,Entry{nullptr,0});
+  old.swap(entries);
+  mask = entries.size() - 1;
+  std::vector<int64_t> order;
+  order.swap(used);
+  for (auto it = order.begin(), end = order.end(); it != end; ++it) {
+    bool added;
+    *insert(old[*it].address,added) = old[*it].value;
+  }
+}
+
+int64_t AddressTable::size() const {
+  return used.size();
+}
+
+int64_t* AddressTable::address(const int64_t i) const {
+  return entries[used[i]].address;
+}
+
+int64_t AddressTable::value(const int64_t i) const {
+  return entries[used[i]].value;
+}
+
+/*=================================WriteLog=================================*/
+static thread_local WriteLog* current_log = nullptr; //of the transactional statement running here
+
+WriteLog::WriteLog() {
+  readSignature = 0;
+}
+
+void WriteLog::clear() {
+  writes.clear();
+  reads.clear();
+  readSignature = 0;
+}
+
+void WriteLog::store(int64_t* address, const int64_t value) {
+  bool added;
+  *writes.insert(address,added) = value;
+}
+
+int64_t WriteLog::load(int64_t* address) {
+  if (writes.size()) {
+    int64_t* value = writes.find(address);
+    if (value) {
+      return *value;
+    }
+  }
+  bool added;
+  reads.insert(address,added);
+  if (added) {
+    readSignature |= bit(address);
+  }
+  return *address;
+}
+
+//Stores of earlier statements are published before this one is checked,
+//  so a write-write overlap is fine and only a read of such an address conflicts
+bool WriteLog::conflicts(AddressTable& written, const uint64_t signature) {
+  if (!(readSignature & signature)) {
+    return false;
+  }
+  if (reads.size() <= written.size()) {
+    for (int64_t i = 0; i < reads.size(); ++i) {
+      if (written.find(reads.address(i))) {
+        return true;
+      }
+    }
+    return false;
+  }
+  for (int64_t i = 0; i < written.size(); ++i) {
+    if (reads.find(written.address(i))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WriteLog::commit(AddressTable& written, uint64_t& signature) {
+  for (int64_t i = 0; i < writes.size(); ++i) {
+    int64_t* address = writes.address(i);
+    *address = writes.value(i);
+    bool added;
+    written.insert(address,added);
+    signature |= bit(address);
+  }
+  clear();
+}
+
+WriteLog* WriteLog::current() {
+  return current_log;
+}
+
+WriteLog* WriteLog::install(WriteLog* log) {
+  WriteLog* previous = current_log;
+  current_log = log;
+  return previous;
+}
+
+uint64_t WriteLog::bit(const int64_t* address) {
+  return (uint64_t)1 << ((((uint64_t)(uintptr_t)address >> 3) * 0x9E3779B97F4A7C15ULL) >> 58);
 }
 
-StatementContext::StatementContext(StatementContext&& sc) {
-  this->int_future_id_map = std::move(sc.int_future_id_map);
-  this->float_future_id_map = std::move(sc.float_future_id_map);
-  this->intptr_future_id_map = std::move(sc.intptr_future_id_map);
-  this->floatptr_future_id_map = std::move(sc.floatptr_future_id_map);
-  this->void_future_id_map = std::move(sc.void_future_id_map);
+/*=================================Transactions=================================*/
+Transactions::Transactions() {
+  commits.store(0,std::memory_order_relaxed);
+  reruns.store(0,std::memory_order_relaxed);
+  on = false;
+}
+
+void Transactions::configure(const bool on) {
+  this->on = on;
+}
+
+bool Transactions::enabled() const {
+  return on;
+}
+
+void Transactions::committed(const bool rerun) {
+  commits.fetch_add(1,std::memory_order_relaxed);
+  if (rerun) {
+    reruns.fetch_add(1,std::memory_order_relaxed);
+  }
+}
+
+void Transactions::report() {
+  if (!on) {
+    return;
+  }
+  printf("Transactions: %lld committed, %lld ran again after a conflict\n",
+    (long long)commits.load(),(long long)reruns.load());
 }
 
 /*=================================StatementContext=================================*/
-void StatementContext::addIntFuture(std::future<int64_t>& f, const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  assert(int_future_id_map.count(id)==0 && "Statement id already exists");
-  int_future_id_map.insert(std::pair<int64_t,std::future<int64_t>>(id,std::move(f)));
+StatementContext::StatementContext() {
+  pool = nullptr;
+  history = nullptr;
+  waits = nullptr;
+  locality = nullptr;
+  transactions = nullptr;
+  slots = nullptr;
+  order = nullptr;
+  estimates = nullptr;
+  capacity = 0;
+  count = 0;
+  signature = 0;
+  uncommitted = 0;
 }
 
-void StatementContext::addFloatFuture(std::future<double>& f, const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  assert(float_future_id_map.count(id)==0 && "Statement id already exists");
-  float_future_id_map.insert(std::pair<int64_t,std::future<double>>(id,std::move(f)));
+StatementContext::~StatementContext() {
+  for (auto it = logs.begin(), end = logs.end(); it != end; ++it) {
+    delete *it;
+  }
+  free(slots);
+  delete[] order;
+  delete[] estimates;
 }
 
-void StatementContext::addIntptrFuture(std::future<int64_t*>& f, const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  assert(intptr_future_id_map.count(id)==0 && "Statement id already exists");
-  intptr_future_id_map.insert(std::pair<int64_t,std::future<int64_t*>>(id,std::move(f)));
+//Heap allocation only happens when a recycled context is too small
+void StatementContext::reset(const int64_t statements, WorkerPool* pool, StatementHistory* history,
+    WaitPolicy* waits, LocalityTable* locality, Transactions* transactions) {
+  this->pool = pool;
+  this->history = history;
+  this->waits = waits;
+  this->locality = locality;
+  this->transactions = transactions;
+  if (statements > capacity) {
+    free(slots);
+    delete[] order;
+    delete[] estimates;
+    order = new int64_t[statements];
+    estimates = new int64_t[statements];
+    void* memory = nullptr;
+    int failed = posix_memalign(&memory,CACHE_LINE_SIZE,statements*sizeof(StatementSlot));
+    assert(!failed && "Unable to allocate statement slots");
+    slots = (StatementSlot*)memory;
+    for (int64_t i = 0; i < statements; ++i) {
+      new (&slots[i]) StatementSlot();
+      slots[i].context = this;
+    }
+    capacity = statements;
+  }
+  for (int64_t i = 0; i < statements; ++i) {
+    slots[i].state.store(SLOT_EMPTY,std::memory_order_relaxed);
+    slots[i].log = nullptr;
+  }
+  count = statements;
+  if (uncommitted || signature) {
+    written.clear();
+    signature = 0;
+    uncommitted = 0;
+  }
 }
 
-void StatementContext::addFloatptrFuture(std::future<double*>& f, const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  assert(floatptr_future_id_map.count(id)==0 && "Statement id already exists");
-  floatptr_future_id_map.insert(std::pair<int64_t,std::future<double*>>(id,std::move(f)));
+StatementSlot* StatementContext::slot(const int64_t id) {
+  assert(id >= 0 && id < count && "Statement id outside of the commit");
+  return &slots[id];
 }
 
-void StatementContext::addVoidFuture(std::future<void>& f, const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  assert(void_future_id_map.count(id)==0 && "Statement id already exists");
-  void_future_id_map.insert(std::pair<int64_t,std::future<void>>(id,std::move(f)));
+void StatementContext::schedule(StatementSlot* s, void* statement, void* env, const SlotType type) {
+  assert(s->state.load(std::memory_order_relaxed) == SLOT_EMPTY && "Statement id already exists");
+  s->statement = statement;
+  s->env = env;
+  s->type = type;
+  s->deferred = false;
+  s->cancelled.store(false,std::memory_order_relaxed);
+  s->waiter.store(nullptr,std::memory_order_relaxed);
+  s->batch = nullptr;
+  s->locality = 0;
+  s->home = -1;
+  s->envSize = 0;
+  s->log = nullptr;
+  s->state.store(SLOT_PENDING,std::memory_order_relaxed);
 }
 
-std::future<int64_t> StatementContext::getIntFuture(const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  auto f = std::move(int_future_id_map.at(id));
-  int_future_id_map.erase(id);
-  return f;
+//Give a scheduled statement a write log, its stores stay private until commit
+void StatementContext::track(StatementSlot* s) {
+  size_t id = s - slots;
+  if (logs.size() <= id) {
+    logs.resize(capacity,nullptr);
+  }
+  if (!logs[id]) {
+    logs[id] = new WriteLog();
+  }
+  logs[id]->clear();
+  s->log = logs[id];
+  ++uncommitted;
 }
 
-std::future<double> StatementContext::getFloatFuture(const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  auto f = std::move(float_future_id_map.at(id));
-  float_future_id_map.erase(id);
-  return f;
+//Transactional statements commit in id order once every statement of the commit finished,
+//  so nothing reads memory while it is published, reconciling one commits every earlier one first
+void StatementContext::commit_through(const int64_t id) {
+  if (!uncommitted) {
+    return;
+  }
+  for (int64_t i = 0; i < count; ++i) {
+    if (slots[i].state.load(std::memory_order_acquire) != SLOT_EMPTY) {
+      wait(&slots[i]);
+    }
+  }
+  for (int64_t i = 0; i <= id && uncommitted; ++i) {
+    if (slots[i].log) {
+      commit(&slots[i]);
+    }
+  }
+}
+
+//A statement that read memory an earlier statement of the commit wrote runs again
+//  on this thread, it now sees every earlier store and cannot conflict
+void StatementContext::commit(StatementSlot* s) {
+  WriteLog* log = s->log;
+  if (s->cancelled.load(std::memory_order_relaxed)) { //its stores are dropped
+    s->log = nullptr;
+    --uncommitted;
+    return;
+  }
+  bool rerun = log->conflicts(written,signature);
+  if (rerun) {
+    log->clear();
+    s->run();
+  }
+  log->commit(written,signature);
+  s->log = nullptr;
+  --uncommitted;
+  transactions->committed(rerun);
+}
+
+//Deferred statements run on the thread that reconciles them
+void StatementContext::run_deferred(StatementSlot* s) {
+  if (s->deferred) {
+    s->deferred = false;
+    s->execute();
+  }
+}
+
+//A waiter is read first, the slot may be recycled once READY is visible
+//A suspended fiber is rescheduled, sleeping threads are woken through the bucket futex
+void StatementContext::finish(StatementSlot* s) {
+  if (s->locality) {
+    locality->record(s->locality,pool->currentSlot(),s->home);
+  }
+  int expected = SLOT_PENDING;
+  if (!s->state.compare_exchange_strong(expected,SLOT_READY,std::memory_order_acq_rel)) {
+    Fiber* waiter = s->waiter.load(std::memory_order_relaxed);
+    WorkerPool* pool = this->pool;
+    s->state.store(SLOT_READY,std::memory_order_seq_cst);
+    if (waiter) {
+      pool->wake(waiter);
+      return;
+    }
+    ParkBucket& bucket = park_bucket(this);
+    bucket.word.fetch_add(1,std::memory_order_seq_cst);
+    if (bucket.sleeping.load(std::memory_order_seq_cst)) {
+      futex_wake_all(&bucket.word);
+    }
+  }
+}
+
+//Sleep until the statement finishes, the sequence read before the check closes the lost wakeup window
+void StatementContext::park(StatementSlot* s) {
+  ParkBucket& bucket = park_bucket(this);
+  bucket.sleeping.fetch_add(1,std::memory_order_seq_cst);
+  while (true) {
+    int sequence = bucket.word.load(std::memory_order_seq_cst);
+    int expected = SLOT_PENDING;
+    s->state.compare_exchange_strong(expected,SLOT_WAITING,std::memory_order_acq_rel);
+    if (s->ready()) {
+      break;
+    }
+    futex_wait(&bucket.word,sequence);
+  }
+  bucket.sleeping.fetch_sub(1,std::memory_order_relaxed);
+}
+
+//Sleep until any of the first n scheduled statements that are still unreconciled finishes
+void StatementContext::park_any(const int64_t n) {
+  ParkBucket& bucket = park_bucket(this);
+  bucket.sleeping.fetch_add(1,std::memory_order_seq_cst);
+  while (true) {
+    int sequence = bucket.word.load(std::memory_order_seq_cst);
+    for (int64_t i = 0; i < n; ++i) {
+      int expected = SLOT_PENDING;
+      slots[i].state.compare_exchange_strong(expected,SLOT_WAITING,std::memory_order_acq_rel);
+    }
+    if (any_ready(0,n)) {
+      break;
+    }
+    futex_wait(&bucket.word,sequence);
+  }
+  bucket.sleeping.fetch_sub(1,std::memory_order_relaxed);
+}
+
+bool StatementContext::any_ready(const int64_t first, const int64_t n) {
+  for (int64_t i = first; i < first + n; ++i) {
+    if (slots[i].ready()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+//Pause for the budget, then yield a few times, returns how far it got before a statement finished
+WaitOutcome StatementContext::spin(const int64_t first, const int64_t n, const int64_t budget) {
+  if (budget > 0) {
+    std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::nanoseconds(budget);
+    do {
+      for (int64_t i = 0; i < WAIT_SPIN_CHECK; ++i) {
+        if (any_ready(first,n)) {
+          return WAIT_SPUN;
+        }
+        cpu_relax();
+      }
+    } while (std::chrono::steady_clock::now() < deadline);
+  }
+  for (int64_t i = 0; i < WAIT_YIELDS; ++i) {
+    std::this_thread::yield();
+    if (any_ready(first,n)) {
+      return WAIT_YIELDED;
+    }
+  }
+  return WAIT_PARKED;
+}
+
+//Suspend the calling fiber until the statement finishes, its thread runs other statements meanwhile
+void StatementContext::suspend(StatementSlot* s) {
+  s->waiter.store(pool->currentFiber(),std::memory_order_relaxed);
+  int expected = SLOT_PENDING;
+  s->state.compare_exchange_strong(expected,SLOT_WAITING,std::memory_order_acq_rel);
+  if (!s->ready()) {
+    WriteLog* log = WriteLog::install(nullptr); //other fibers of this thread start without it
+    pool->block();
+    WriteLog::install(log);
+  }
+}
+
+//Suspend until any of the first n scheduled statements finishes, wakeups may be spurious
+void StatementContext::suspend_any(const int64_t n) {
+  Fiber* self = pool->currentFiber();
+  for (int64_t i = 0; i < n; ++i) {
+    if (slots[i].state.load(std::memory_order_relaxed) == SLOT_EMPTY) {
+      continue;
+    }
+    slots[i].waiter.store(self,std::memory_order_relaxed);
+    int expected = SLOT_PENDING;
+    slots[i].state.compare_exchange_strong(expected,SLOT_WAITING,std::memory_order_acq_rel);
+    if (slots[i].ready()) {
+      return;
+    }
+  }
+  WriteLog* log = WriteLog::install(nullptr);
+  pool->block();
+  WriteLog::install(log);
+}
+
+//Own statements first, then a plain thread steals, then both spin and yield briefly,
+//  and finally a fiber suspends while a plain thread sleeps
+void StatementContext::wait(StatementSlot* s) {
+  run_deferred(s);
+  bool timed = waits->timed();
+  if (s->ready()) {
+    if (timed) waits->completed(0,WAIT_READY);
+    return;
+  }
+  std::chrono::steady_clock::time_point start;
+  if (timed) start = std::chrono::steady_clock::now();
+  WaitOutcome outcome = WAIT_HELPED;
+  while (!s->ready()) {
+    if (pool->runPending()) {
+      continue;
+    }
+    bool suspendable = pool->suspendable();
+    if (!suspendable && pool->help()) {
+      continue;
+    }
+    if (outcome == WAIT_HELPED) {
+      outcome = spin(s - slots,1,waits->budget(history->estimate(s->statement)));
+    } else if (suspendable) {
+      suspend(s);
+    } else {
+      park(s);
+    }
+  }
+  if (timed) waits->completed(elapsed_ns(start),outcome);
+}
+
+//Order the first n scheduled statements for the pool and return the number of tasks
+//  longest known first, so thieves start the critical path first, then unknown ones,
+//  then short ones chained into batches the forker usually keeps for itself
+int64_t StatementContext::plan(const int64_t n) {
+  bool known = false;
+  for (int64_t id = 0; id < n; ++id) {
+    order[id] = id;
+    estimates[id] = history->estimate(slots[id].statement);
+    known |= estimates[id] >= 0;
+  }
+  if (!known) {
+    return n;
+  }
+  const int64_t* key = estimates;
+  std::sort(order,order+n,[key](const int64_t a, const int64_t b) {
+    int64_t ka = (key[a] < 0) ? HISTORY_SHORT_NS : key[a];
+    int64_t kb = (key[b] < 0) ? HISTORY_SHORT_NS : key[b];
+    return ka > kb || (ka == kb && a < b);
+  });
+  int64_t tasks = 0;
+  StatementSlot* tail = nullptr;
+  int64_t batched = 0;
+  for (int64_t i = 0; i < n; ++i) {
+    int64_t id = order[i];
+    int64_t estimate = estimates[id];
+    if (estimate < 0 || estimate >= HISTORY_SHORT_NS) {
+      order[tasks++] = id;
+      continue;
+    }
+    if (tail && batched + estimate <= HISTORY_BATCH_NS) {
+      tail->batch = &slots[id];
+      tail = &slots[id];
+      batched += estimate;
+      continue;
+    }
+    tail = &slots[id];
+    batched = estimate;
+    order[tasks++] = id;
+  }
+  return tasks;
+}
+
+StatementSlot* StatementContext::planned(const int64_t task) {
+  return &slots[order[task]];
 }
 
-std::future<int64_t*> StatementContext::getIntptrFuture(const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  auto f = std::move(intptr_future_id_map.at(id));
-  intptr_future_id_map.erase(id);
-  return f;
+//Statements that were never reconciled must still finish before the slots are reused
+void StatementContext::drain() {
+  for (int64_t i = 0; i < count; ++i) {
+    if (slots[i].state.load(std::memory_order_acquire) != SLOT_EMPTY) {
+      wait(&slots[i]);
+    }
+  }
+  commit_through(count - 1);
 }
 
-std::future<double*> StatementContext::getFloatptrFuture(const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  auto f = std::move(floatptr_future_id_map.at(id));
-  floatptr_future_id_map.erase(id);
-  return f;
+/*=================================ContextCache=================================*/
+static thread_local ContextCache context_cache;
+
+ContextCache::~ContextCache() {
+  for (auto it = free_contexts.begin(), end = free_contexts.end(); it != end; ++it) {
+    delete *it;
+  }
 }
 
-std::future<void> StatementContext::getVoidFuture(const int64_t id) {
-  std::lock_guard<std::mutex> section_monitor(map_mutex);
-  auto f = std::move(void_future_id_map.at(id));
-  void_future_id_map.erase(id);
-  return f;
+StatementContext* ContextCache::acquire() {
+  if (free_contexts.empty()) {
+    return new StatementContext();
+  }
+  StatementContext* context = free_contexts.back();
+  free_contexts.pop_back();
+  return context;
+}
+
+void ContextCache::release(StatementContext* context) {
+  free_contexts.push_back(context);
 }
 
 /*=================================ParContextManager=================================*/
 ParContextManager::ParContextManager() {
-  set_max_threads();
-  thread_count = 0;
-  next_cid = 0;
+  pool_ready.store(false);
+  detect_max_threads();
+}
+
+ParContextManager::~ParContextManager() {
+  if (report) {
+    pool.report();
+    waits.report();
+    locality.report();
+    transactions.report();
+    if (remote.peers()) {
+      remote.report();
+    }
+    printf("Statement history: %d statements\n",(int)history.size());
+  }
 }
 
-int64_t ParContextManager::make_context() {
-  std::lock_guard<std::mutex> section_monitor(mutex);
-  int64_t cid = next_cid++;
-  context_map.insert(std::pair<int64_t,StatementContext>(cid,std::move(StatementContext())));
-  return cid;
+StatementContext* ParContextManager::context_of(const int64_t cid) {
+  assert(cid && "Invalid context handle");
+  return (StatementContext*)(intptr_t)cid;
+}
+
+//Checked on every make_context, the flag keeps call_once off the fork path
+void ParContextManager::start_pool() {
+  if (pool_ready.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::call_once(pool_started,&ParContextManager::launch_pool,this);
+  pool_ready.store(true,std::memory_order_release);
+}
+
+int64_t ParContextManager::make_context(const int64_t statements) {
+  start_pool();
+  StatementContext* context = context_cache.acquire();
+  context->reset(statements,&pool,&history,&waits,&locality,&transactions);
+  return (int64_t)(intptr_t)context;
 }
 
 void ParContextManager::destroy_context(const int64_t cid) {
-  std::lock_guard<std::mutex> section_monitor(mutex);
-  assert(context_map.count(cid)==1 && "Couldnt find exactly one context to destroy");
-  context_map.erase(cid);
+  StatementContext* context = context_of(cid);
+  context->drain();
+  context_cache.release(context);
 }
 
-void ParContextManager::sched_int(int64_t (*statement)(void*),void* env,const int64_t id,const int64_t cid) {
-  std::lock_guard<std::mutex> section_monitor(mutex);
-  std::future<int64_t> promise;
-  if (thread_count >= max_threads) {
-    promise = std::async(std::launch::deferred,statement,env);
+//Every worker is busy and enough work is already queued
+//  the saturation policy decides whether the statement runs now or at recon
+bool ParContextManager::saturate(StatementSlot* s) {
+  if (saturation == SATURATION_QUEUE || !pool.saturated()) {
+    return false;
+  }
+  if (saturation == SATURATION_INLINE) {
+    s->execute(); //work-first, the caller is as good as any worker
   } else {
-    promise = std::async(std::launch::async,statement,env);
-    thread_count++;
+    while (s) { //unbatched, so a waiter on any of them runs its own statement
+      StatementSlot* next = s->batch;
+      s->batch = nullptr;
+      s->deferred = true;
+      s = next;
+    }
   }
-  context_map.at(cid).addIntFuture(promise,id);
+  return true;
 }
 
-void ParContextManager::sched_float(double (*statement)(void*),void* env,const int64_t id,const int64_t cid) {
-  std::lock_guard<std::mutex> section_monitor(mutex);
-  std::future<double> promise;
-  if (thread_count >= max_threads) {
-    promise = std::async(std::launch::deferred,statement,env);
-  } else {
-    promise = std::async(std::launch::async,statement,env);
-    thread_count++;
+//Lazy task creation: the slot is always pushed where idle workers can steal it
+//  but nobody is woken while every worker is busy, the forker pops it back at recon
+void ParContextManager::schedule(void* statement,void* env,const SlotType type,const int64_t id,const int64_t cid) {
+  StatementContext* context = context_of(cid);
+  StatementSlot* s = context->slot(id);
+  context->schedule(s,statement,env,type);
+  if (transactions.enabled()) {
+    if (WriteLog::current()) {
+      s->deferred = true; //forked inside a transaction, runs at recon under the enclosing log
+      return;
+    }
+    context->track(s);
+  }
+  if (lazy) {
+    if (pool.enqueue(s)) {
+      if (history.estimate(statement) >= HISTORY_SHORT_NS) {
+        pool.signal(1); //known to be long, worth waking a worker for
+      } else {
+        pool.offer(1);
+      }
+    } else {
+      s->execute();
+    }
+  } else if (!saturate(s)) {
+    pool.submit(s);
   }
-  context_map.at(cid).addFloatFuture(promise,id);
 }
 
-void ParContextManager::sched_intptr(int64_t* (*statement)(void*),void* env,int64_t id,const int64_t cid) {
-  std::lock_guard<std::mutex> section_monitor(mutex);
-  std::future<int64_t*> promise;
-  if (thread_count >= max_threads) {
-    promise = std::async(std::launch::deferred,statement,env);
-  } else {
-    promise = std::async(std::launch::async,statement,env);
-    thread_count++;
+//Queue with the worker that last ran the statement's memory, otherwise where idle workers steal it
+//Known short statements stay with the forker, moving them costs more than a warm cache saves
+bool ParContextManager::place(StatementSlot* s) {
+  int64_t slot = s->locality ? locality.preferred(s->locality) : -1;
+  if (slot < 0) {
+    return pool.enqueue(s);
+  }
+  int64_t estimate = history.estimate(s->statement);
+  if (estimate >= 0 && estimate < HISTORY_SHORT_NS) {
+    return pool.enqueue(s);
   }
-  context_map.at(cid).addIntptrFuture(promise,id);
+  s->home = slot;
+  return pool.enqueueAt(s,slot);
 }
 
-void ParContextManager::sched_floatptr(double* (*statement)(void*),void* env,int64_t id,const int64_t cid) {
-  std::lock_guard<std::mutex> section_monitor(mutex);
-  std::future<double*> promise;
-  if (thread_count >= max_threads) {
-    promise = std::async(std::launch::deferred,statement,env);
-  } else {
-    promise = std::async(std::launch::async,statement,env);
-    thread_count++;
+//Queue the whole group in planned order before waking any worker
+//  tasks the pool has no room for follow the saturation policy once the rest is out
+void ParContextManager::sched_group(const StatementDescriptor* descriptors,const int64_t n,const int64_t cid) {
+  StatementContext* context = context_of(cid);
+  for (int64_t id = 0; id < n; ++id) {
+    StatementSlot* s = context->slot(id);
+    context->schedule(s,descriptors[id].statement,descriptors[id].env,(SlotType)descriptors[id].type);
+    s->locality = locality.key(descriptors[id].hint,descriptors[id].statement,id);
+    s->envSize = descriptors[id].size;
+  }
+  if (transactions.enabled()) {
+    bool nested = WriteLog::current() != nullptr;
+    for (int64_t id = 0; id < n; ++id) {
+      StatementSlot* s = context->slot(id);
+      if (nested) {
+        s->deferred = true;
+      } else {
+        context->track(s);
+      }
+      s->envSize = 0; //stores of a worker process would bypass the log
+    }
+    if (nested) {
+      return;
+    }
+  }
+  int64_t tasks = context->plan(n);
+  int64_t queued = 0;
+  int64_t saturated = tasks;
+  int64_t dealt = 0;
+  for (int64_t task = 0; task < tasks; ++task) {
+    StatementSlot* s = context->planned(task);
+    //statements that may leave the process are dealt round robin, this process takes one share
+    if (s->envSize && !s->batch && remote.peers() && (dealt++ % (remote.peers() + 1)) && remote.submit(s,s->envSize)) {
+      continue;
+    }
+    if (!lazy && saturation != SATURATION_QUEUE && pool.saturated()) {
+      saturated = task;
+      break;
+    }
+    if (!place(s)) {
+      s->execute();
+      continue;
+    }
+    ++queued;
+  }
+  bool urgent = tasks && history.estimate(context->planned(0)->statement) >= HISTORY_SHORT_NS;
+  if (queued && lazy && !urgent) {
+    pool.offer(queued);
+  } else if (queued) {
+    pool.signal(queued);
+  }
+  for (int64_t task = saturated; task < tasks; ++task) {
+    StatementSlot* s = context->planned(task);
+    if (!saturate(s)) {
+      pool.submit(s);
+    }
   }
-  context_map.at(cid).addFloatptrFuture(promise,id);
+}
+
+//Copy results into results[id] as the statements finish, in completion order
+//  a float result is stored as its bit pattern, void statements leave their entry untouched
+void ParContextManager::recon_group(int64_t* results,const int64_t n,const int64_t cid) {
+  StatementContext* context = context_of(cid);
+  context->commit_through(n - 1); //a statement that runs again changes its result
+  int64_t left = 0;
+  for (int64_t id = 0; id < n; ++id) {
+    left += context->slot(id)->state.load(std::memory_order_relaxed) != SLOT_EMPTY;
+  }
+  bool timed = waits.timed();
+  std::chrono::steady_clock::time_point start;
+  WaitOutcome outcome = WAIT_READY;
+  while (left) {
+    bool collected = false;
+    StatementSlot* deferred = nullptr;
+    for (int64_t id = 0; id < n; ++id) {
+      StatementSlot* s = context->slot(id);
+      if (s->state.load(std::memory_order_relaxed) == SLOT_EMPTY) {
+        continue;
+      }
+      if (s->ready()) {
+        if (s->type != SLOT_VOID) {
+          memcpy(&results[id],&s->result,sizeof(int64_t));
+        }
+        s->state.store(SLOT_EMPTY,std::memory_order_relaxed); //reconciled, destroy_context skips it
+        collected = true;
+        --left;
+      } else if (s->deferred && !deferred) {
+        deferred = s;
+      }
+    }
+    if (!left || collected) {
+      continue;
+    }
+    if (deferred) {
+      context->run_deferred(deferred);
+      continue;
+    }
+    if (outcome == WAIT_READY) {
+      if (timed) start = std::chrono::steady_clock::now();
+      outcome = WAIT_HELPED;
+    }
+    if (pool.runPending()) {
+      while (pool.runPending()); //own statements first, results are collected after
+    } else if (!pool.suspendable() && pool.help()) {
+      while (pool.runPending());
+    } else if (outcome == WAIT_HELPED) {
+      outcome = context->spin(0,n,waits.budget(-1));
+    } else if (pool.suspendable()) {
+      context->suspend_any(n);
+    } else {
+      context->park_any(n);
+    }
+  }
+  if (timed) waits.completed((outcome == WAIT_READY) ? 0 : elapsed_ns(start),outcome);
+}
+
+//Speculative if statement: statement 0 sets *taken to the condition, 1 and 2 are the then and else branches
+//  once the condition is known the losing branch is cancelled, it only runs if it already started
+int64_t ParContextManager::recon_branch(int64_t* results,const int64_t n,const int64_t* taken,const int64_t cid) {
+  await(0,cid);
+  int64_t then = *taken != 0;
+  int64_t loser = then ? 2 : 1;
+  if (loser < n) {
+    context_of(cid)->slot(loser)->cancelled.store(true,std::memory_order_relaxed);
+  }
+  recon_group(results,n,cid);
+  return then;
+}
+
+void ParContextManager::sched_int(int64_t (*statement)(void*),void* env,const int64_t id,const int64_t cid) {
+  schedule((void*)statement,env,SLOT_INT,id,cid);
+}
+
+void ParContextManager::sched_float(double (*statement)(void*),void* env,const int64_t id,const int64_t cid) {
+  schedule((void*)statement,env,SLOT_FLOAT,id,cid);
+}
+
+void ParContextManager::sched_intptr(int64_t* (*statement)(void*),void* env,int64_t id,const int64_t cid) {
+  schedule((void*)statement,env,SLOT_INTPTR,id,cid);
+}
+
+void ParContextManager::sched_floatptr(double* (*statement)(void*),void* env,int64_t id,const int64_t cid) {
+  schedule((void*)statement,env,SLOT_FLOATPTR,id,cid);
 }
 
 void ParContextManager::sched_void(void (*statement)(void*),void* env,int64_t id,const int64_t cid) {
-  std::lock_guard<std::mutex> section_monitor(mutex);
-  std::future<void> promise;
-  if (thread_count >= max_threads) {
-    promise = std::async(std::launch::deferred,statement,env);
+  schedule((void*)statement,env,SLOT_VOID,id,cid);
+}
+
+//Keep the thread busy until the result is ready, a fiber suspends and its thread
+//  runs other statements, a plain thread steals them and sleeps only when there are none
+StatementSlot* ParContextManager::await(const int64_t id,const int64_t cid) {
+  StatementContext* context = context_of(cid);
+  StatementSlot* s = context->slot(id);
+  context->wait(s);
+  context->commit_through(id);
+  return s;
+}
+
+//Suspend the calling fiber instead of its thread, false when not running on a fiber
+bool ParContextManager::sleep_ms(const int64_t ms) {
+  start_pool();
+  WriteLog* log = WriteLog::install(nullptr); //other fibers of this thread start without it
+  bool slept = pool.sleepFor(ms);
+  WriteLog::install(log);
+  return slept;
+}
+
+//Inside a transactional statement stores are buffered and loads see them, elsewhere both are plain
+void ParContextManager::tx_store(int64_t* address,const int64_t value) {
+  WriteLog* log = WriteLog::current();
+  if (log) {
+    log->store(address,value);
   } else {
-    promise = std::async(std::launch::async,statement,env);
-    thread_count++;
+    *address = value;
   }
-  context_map.at(cid).addVoidFuture(promise,id);
+}
+
+int64_t ParContextManager::tx_load(int64_t* address) {
+  WriteLog* log = WriteLog::current();
+  return log ? log->load(address) : *address;
+}
+
+//Bracket a call that blocks its thread, a worker is replaced while it blocks
+void ParContextManager::enter_blocking() {
+  pool.enterBlocking();
+}
+
+void ParContextManager::leave_blocking() {
+  pool.leaveBlocking();
 }
 
 int64_t ParContextManager::recon_int(const int64_t original,const int64_t known,
                 const int64_t id,const int64_t max,const int64_t cid) {
-  mutex.lock();
-  std::chrono::milliseconds span(0);
-  std::future<int64_t> fv = context_map.at(cid).getIntFuture(id);
-  int64_t v;
-  mutex.unlock();
-  if (fv.wait_for(span)==std::future_status::deferred) {
-    v = fv.get();
-  } else {
-    v = fv.get();
-    mutex.lock();
-    thread_count--;
-    mutex.unlock();
-  }
-  return v;
+  return await(id,cid)->result.i;
 }
 
 double ParContextManager::recon_float(const double original,const int64_t known,
                 const int64_t id,const int64_t max,const int64_t cid) {
-  mutex.lock();
-  std::chrono::milliseconds span(0);
-  std::future<double> fv = context_map.at(cid).getFloatFuture(id);
-  double v;
-  mutex.unlock();
-  if (fv.wait_for(span)==std::future_status::deferred) {
-    v = fv.get();
-  } else {
-    v = fv.get();
-    mutex.lock();
-    thread_count--;
-    mutex.unlock();
-  }
-  return v;
+  return await(id,cid)->result.f;
 }
 
 int64_t* ParContextManager::recon_intptr(const int64_t* original,const int64_t known,
                 const int64_t id,const int64_t max,const int64_t cid) {
-  mutex.lock();
-  std::chrono::milliseconds span(0);
-  std::future<int64_t*> fv = context_map.at(cid).getIntptrFuture(id);
-  int64_t* v;
-  mutex.unlock();
-  if (fv.wait_for(span)==std::future_status::deferred) {
-    v = fv.get();
-  } else {
-    v = fv.get();
-    mutex.lock();
-    thread_count--;
-    mutex.unlock();
-  }
-  return v;
+  return await(id,cid)->result.ip;
 }
 
 double* ParContextManager::recon_floatptr(const double* original,const int64_t known,
                 const int64_t id,const int64_t max,const int64_t cid) {
-  mutex.lock();
-  std::chrono::milliseconds span(0);
-  std::future<double*> fv = context_map.at(cid).getFloatptrFuture(id);
-  double* v;
-  mutex.unlock();
-  if (fv.wait_for(span)==std::future_status::deferred) {
-    v = fv.get();
-  } else {
-    v = fv.get();
-    mutex.lock();
-    thread_count--;
-    mutex.unlock();
-  }
-  return v;
+  return await(id,cid)->result.fp;
 }
 
 void ParContextManager::recon_void(const int64_t id,const int64_t max,const int64_t cid) {
-  mutex.lock();
-  std::chrono::milliseconds span(0);
-  std::future<void> fv = context_map.at(cid).getVoidFuture(id);
-  mutex.unlock();
-  if (fv.wait_for(span)==std::future_status::deferred) {
-    fv.get();
+  await(id,cid);
+}
+
+//Quota of a cgroup in CPUs, zero when unlimited or unreadable
+//  v2 stores "max 100000" or "<quota> <period>" in cpu.max
+//  v1 stores quota and period in separate files, quota -1 is unlimited
+static double read_cgroup_quota(const std::string& dir, const bool v2) {
+  double quota = 0;
+  double period = 0;
+  if (v2) {
+    FILE* f = fopen((dir + "/cpu.max").c_str(),"r");
+    if (!f) return 0;
+    char text[32];
+    if (fscanf(f,"%31s %lf",text,&period) == 2 && strcmp(text,"max")) {
+      quota = atof(text);
+    }
+    fclose(f);
   } else {
-    fv.get();
-    mutex.lock();
-    thread_count--;
-    mutex.unlock();
+    FILE* f = fopen((dir + "/cpu.cfs_quota_us").c_str(),"r");
+    if (!f) return 0;
+    if (fscanf(f,"%lf",&quota) != 1) quota = 0;
+    fclose(f);
+    f = fopen((dir + "/cpu.cfs_period_us").c_str(),"r");
+    if (!f) return 0;
+    if (fscanf(f,"%lf",&period) != 1) period = 0;
+    fclose(f);
+  }
+  return (quota > 0 && period > 0) ? quota/period : 0;
+}
+
+//Find the cgroup of this process in /proc/self/cgroup and read its CPU quota
+//Inside a container the cgroup is usually mounted as the root, so try that too
+static double detect_cgroup_quota() {
+  FILE* f = fopen("/proc/self/cgroup","r");
+  if (!f) return 0;
+  double quota = 0;
+  char line[512];
+  while (!quota && fgets(line,sizeof(line),f)) {
+    std::string entry(line);
+    entry.erase(entry.find_last_not_of("\n")+1);
+    size_t first = entry.find(':');
+    size_t second = entry.find(':',first+1);
+    if (first == std::string::npos || second == std::string::npos) continue;
+    std::string controllers = "," + entry.substr(first+1,second-first-1) + ",";
+    std::string path = entry.substr(second+1);
+    if (controllers == ",,") { //v2 unified hierarchy
+      quota = read_cgroup_quota("/sys/fs/cgroup" + path,true);
+      if (!quota) quota = read_cgroup_quota("/sys/fs/cgroup",true);
+    } else if (controllers.find(",cpu,") != std::string::npos) {
+      const char* mounts[] = {"/sys/fs/cgroup/cpu,cpuacct","/sys/fs/cgroup/cpu"};
+      for (int m = 0; m < 2 && !quota; ++m) {
+        quota = read_cgroup_quota(mounts[m] + path,false);
+        if (!quota) quota = read_cgroup_quota(mounts[m],false);
+      }
+    }
+  }
+  fclose(f);
+  return quota;
+}
+
+//Parse a sysfs CPU list such as "0-3,8-11"
+static std::vector<int> parse_cpu_list(const char* text) {
+  std::vector<int> cpus;
+  while (*text) {
+    char* end = nullptr;
+    long first = strtol(text,&end,10);
+    if (end == text) break;
+    long last = first;
+    if (*end == '-') {
+      text = end + 1;
+      last = strtol(text,&end,10);
+    }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+    text = (*end == ',') ? end + 1 : end;
+  }
+  return cpus;
+}
+
+//NUMA nodes with the CPUs of each that the affinity mask allows, nodes without any are dropped
+//Without sysfs every allowed CPU forms a single node
+static std::vector<std::vector<int> > detect_numa_nodes() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  bool masked = !sched_getaffinity(0,sizeof(set),&set);
+  std::vector<std::pair<int,std::vector<int> > > found;
+  if (DIR* dir = opendir("/sys/devices/system/node")) {
+    while (struct dirent* entry = readdir(dir)) {
+      int node;
+      if (sscanf(entry->d_name,"node%d",&node) != 1) continue;
+      std::string path = std::string("/sys/devices/system/node/") + entry->d_name + "/cpulist";
+      FILE* f = fopen(path.c_str(),"r");
+      if (!f) continue;
+      char line[4096];
+      std::vector<int> cpus;
+      if (fgets(line,sizeof(line),f)) {
+        std::vector<int> listed = parse_cpu_list(line);
+        for (auto cpu = listed.begin(), last = listed.end(); cpu != last; ++cpu) {
+          if (!masked || (*cpu < CPU_SETSIZE && CPU_ISSET(*cpu,&set))) cpus.push_back(*cpu);
+        }
+      }
+      fclose(f);
+      if (!cpus.empty()) found.push_back(std::make_pair(node,cpus));
+    }
+    closedir(dir);
+  }
+  std::sort(found.begin(),found.end());
+  std::vector<std::vector<int> > nodes;
+  for (auto it = found.begin(), end = found.end(); it != end; ++it) {
+    nodes.push_back(it->second);
+  }
+  if (nodes.empty() && masked) {
+    nodes.push_back(std::vector<int>());
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu,&set)) nodes[0].push_back(cpu);
+    }
+  }
+  return nodes;
+}
+
+//CPUs this process may run on
+static int64_t detect_affinity() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0,sizeof(set),&set)) {
+    return 0;
+  }
+  return CPU_COUNT(&set);
+}
+
+//Positive integer from the environment, zero when unset or invalid
+static int64_t env_threads(const char* name) {
+  const char* value = getenv(name);
+  return value ? std::max(atol(value),0L) : 0;
+}
+
+//Limit is the smaller of the affinity mask and the cgroup quota
+//FORK_THREADS overrides the detected limit, FORK_REPORT prints the decision
+//FORK_SATURATION selects queue (default with fibers), inline (default without) or deferred
+//FORK_FIBERS=0 runs statements directly on the worker threads
+//FORK_LAZY=0 publishes every statement eagerly and applies the saturation policy
+//FORK_HISTORY=0 turns off per-statement timing and critical-path ordering
+//Forked statements get stacks as large as the main thread's, deep recursion that works serially
+//  keeps working forked, FORK_STACK_MB overrides the size
+static size_t detect_stack_size() {
+  size_t size = FIBER_STACK_SIZE;
+  struct rlimit limit;
+  if (!getrlimit(RLIMIT_STACK,&limit)) {
+    size = (limit.rlim_cur == RLIM_INFINITY) ? UNLIMITED_STACK_SIZE : std::max(size,(size_t)limit.rlim_cur);
+  }
+  int64_t requested = env_threads("FORK_STACK_MB");
+  if (requested) {
+    size = (size_t)requested*1024*1024;
+  }
+  return (size + FIBER_GUARD_SIZE - 1)/FIBER_GUARD_SIZE*FIBER_GUARD_SIZE;
+}
+
+//FORK_COMPENSATION caps the workers added while others block, default the thread limit, 0 disables
+//FORK_TRANSACTIONS=1 buffers stores of forked statements and commits them at recon in id order
+//FORK_REMOTE=host:port,... also deals pointer-free statements of commit groups to worker processes
+//FORK_LOCALITY=0 ignores memory hints and queues every statement with its forker
+//FORK_SPIN=0 sleeps in recon waits without spinning first
+//FORK_PIN=core pins every worker to one CPU, FORK_PIN=node to the CPUs of its NUMA node
+void ParContextManager::detect_max_threads() {
+  int64_t hardware = std::thread::hardware_concurrency();
+  int64_t affinity = detect_affinity();
+  double quota = detect_cgroup_quota();
+  int64_t detected = affinity ? affinity : std::max(hardware,(int64_t)1);
+  if (quota > 0) {
+    detected = std::min(detected,(int64_t)std::max(std::ceil(quota),1.0));
+  }
+  int64_t requested = env_threads("FORK_THREADS");
+  default_threads = requested ? requested : detected;
+  ceiling_threads = std::max(hardware,default_threads); //room to raise the limit at runtime
+  const char* compensation = getenv("FORK_COMPENSATION");
+  compensation_threads = compensation ? env_threads("FORK_COMPENSATION") : default_threads;
+  stack_size = detect_stack_size();
+  report = getenv("FORK_REPORT") != nullptr;
+  const char* fiber = getenv("FORK_FIBERS");
+  fibers = !fiber || strcmp(fiber,"0");
+  //A queued statement only costs a fiber, an inline one that blocks would stall its forker
+  saturation = fibers ? SATURATION_QUEUE : SATURATION_INLINE;
+  numa_nodes = detect_numa_nodes();
+  pin = PIN_NONE;
+  const char* binding = getenv("FORK_PIN");
+  if (binding && !strcmp(binding,"core")) pin = PIN_CORE;
+  else if (binding && !strcmp(binding,"node")) pin = PIN_NODE;
+  const char* timing = getenv("FORK_HISTORY");
+  history.enable(!timing || strcmp(timing,"0"));
+  const char* transactional = getenv("FORK_TRANSACTIONS");
+  transactions.configure(transactional && strcmp(transactional,"0"));
+  const char* peers = getenv("FORK_REMOTE");
+  remote_peers = peers ? peers : "";
+  const char* placing = getenv("FORK_LOCALITY");
+  locality.configure(!placing || strcmp(placing,"0"),report);
+  const char* spinning = getenv("FORK_SPIN");
+  waits.configure(detected,!spinning || strcmp(spinning,"0"),report);
+  const char* eager = getenv("FORK_LAZY");
+  lazy = !eager || strcmp(eager,"0");
+  const char* policy = getenv("FORK_SATURATION");
+  if (policy && !strcmp(policy,"queue")) saturation = SATURATION_QUEUE;
+  else if (policy && !strcmp(policy,"inline")) saturation = SATURATION_INLINE;
+  else if (policy && !strcmp(policy,"deferred")) saturation = SATURATION_DEFERRED;
+  if (report) {
+    printf("Detected %d compute elements, affinity %d, cgroup quota ",(int)hardware,(int)affinity);
+    if (quota > 0) printf("%.2f CPUs\n",quota);
+    else printf("none\n");
+    printf("Setting max execution threads: %d%s\n",(int)default_threads,requested ? " (FORK_THREADS)" : "");
+    const char* policies[] = {"queue","inline","deferred"};
+    printf("Saturation policy: %s%s\n",policies[saturation],lazy ? " (unused, lazy task creation)" : "");
+    printf("Fibers: %s\n",fibers ? "on" : "off");
+    printf("Compensation workers for blocking calls: up to %d\n",(int)compensation_threads);
+    printf("Worker and fiber stacks: %d MB\n",(int)(stack_size/(1024*1024)));
+    printf("Transactions: %s\n",transactions.enabled() ? "on" : "off");
+    printf("Recon spinning: %s\n",(!spinning || strcmp(spinning,"0")) ? "on" : "off");
+    const char* pins[] = {"none","core","node"};
+    printf("NUMA nodes: %d, pinning: %s\n",(int)std::max(numa_nodes.size(),(size_t)1),pins[pin]);
+    for (size_t node = 0; node < numa_nodes.size(); ++node) {
+      printf("  node %d: %d CPUs\n",(int)node,(int)numa_nodes[node].size());
+    }
+  }
+}
+
+void ParContextManager::launch_pool() {
+  pool.place(numa_nodes,pin);
+  pool.start(default_threads,ceiling_threads,compensation_threads,fibers,stack_size);
+  if (!remote_peers.empty()) {
+    int64_t peers = remote.connect(remote_peers.c_str(),&pool);
+    if (report) {
+      printf("Remote workers: %d connected\n",(int)peers);
+    }
   }
 }
 
-void ParContextManager::set_max_threads() {
-  unsigned long dth = std::thread::hardware_concurrency();
-  printf("Detected %d compute elements.\n",(int)dth);
-  if (dth < 2) max_threads = 2;
-  else if (dth > 4) max_threads = 4;
-  else max_threads = dth;
-  printf("Setting max execution threads: %d\n",(int)max_threads);
+//Change the limit at runtime, zero or less restores the default
+//The pool never grows past the larger of the hardware and the startup limit
+void ParContextManager::set_max_threads(const int64_t threads) {
+  start_pool();
+  pool.setLimit((threads > 0) ? threads : default_threads);
+  if (report) {
+    printf("Setting max execution threads: %d\n",(int)pool.getLimit());
+  }
 }
 
+int64_t ParContextManager::get_max_threads() {
+  start_pool();
+  return pool.getLimit();
+}
+
+//Topology as the pool uses it, a machine without NUMA is a single node
+int64_t ParContextManager::get_numa_nodes() {
+  start_pool();
+  return pool.nodeCount();
+}
+
+//Node of the calling thread, the home node when called from a statement on a worker
+int64_t ParContextManager::get_numa_node() {
+  start_pool();
+  return pool.currentNode();
+}
+
+int64_t ParContextManager::get_node_cpus(const int64_t node) {
+  start_pool();
+  return pool.nodeCpus(node);
+}
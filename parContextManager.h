@@ -6,46 +6,298 @@
 #ifndef __PARCONTEXTMANAGER_H
 #define __PARCONTEXTMANAGER_H
 
-#include <unordered_map>
+#include <atomic>
 #include <vector>
 #include <mutex>
 #include <thread>
-#include <future>
 #include <chrono>
 #include <random>
+#include <string>
 #include <cassert>
 #include <stdint.h>
 #include <stdio.h>
+#include "workerPool.h"
+#include "remote.h"
 
 //All methods can be safely called from any thread and in parallel
 
+#define CACHE_LINE_SIZE 64
+
+//Worker stacks when the main thread's stack is unlimited, only touched pages cost memory
+#define UNLIMITED_STACK_SIZE ((size_t)1024*1024*1024)
+
+//Execution time history, one entry per statement function
+#define HISTORY_BITS 10
+#define HISTORY_ENTRIES (1 << HISTORY_BITS)
+#define HISTORY_PROBES 16
+#define HISTORY_SHORT_NS 20000 //known shorter statements are batched and only sampled
+#define HISTORY_BATCH_NS 50000 //expected run time of one batch of short statements
+#define HISTORY_SAMPLE 64 //a short statement is timed once per HISTORY_SAMPLE runs
+
+//Worker that last ran a statement, keyed by its memory hint
+#define LOCALITY_BITS 12
+#define LOCALITY_ENTRIES (1 << LOCALITY_BITS)
+#define LOCALITY_SLOT_BITS 16 //low bits of an entry hold the slot, the rest tag the key
+
+//Recon waits spin, then yield, then sleep
+#define WAIT_SPIN_NS 50000 //never spin longer, a longer statement is worth a sleep
+#define WAIT_SPIN_DEFAULT_NS 2000 //spin budget before anything has been measured
+#define WAIT_SPIN_CHECK 64 //pause instructions between two clock reads
+#define WAIT_YIELDS 8
+#define WAIT_BUCKETS 32 //log2 nanosecond buckets of the wait histogram
+
+enum SlotType {
+	SLOT_INT,
+	SLOT_FLOAT,
+	SLOT_INTPTR,
+	SLOT_FLOATPTR,
+	SLOT_VOID
+};
+
+enum SlotState {
+	SLOT_EMPTY, //not scheduled in this commit
+	SLOT_PENDING,
+	SLOT_WAITING, //pending with a parked or suspended waiter
+	SLOT_READY
+};
+
+//What a statement does when the pool is saturated
+//  queue: push it anyway, an idle worker or the recon thread picks it up
+//  inline: run it immediately on the scheduling thread
+//  deferred: run it on the recon thread when it is reconciled
+enum SaturationPolicy {
+	SATURATION_QUEUE,
+	SATURATION_INLINE,
+	SATURATION_DEFERRED
+};
+
+//How far a recon wait had to go before its statement was ready
+enum WaitOutcome {
+	WAIT_READY, //finished before the wait started
+	WAIT_HELPED, //the waiter ran other statements meanwhile
+	WAIT_SPUN,
+	WAIT_YIELDED,
+	WAIT_PARKED, //suspended fiber or sleeping thread
+	WAIT_OUTCOMES
+};
+
+//One statement of a batched commit group, laid out as {i64*, i64*, i64, i64, i64} by the code generator
+struct StatementDescriptor {
+	void* statement;
+	void* env;
+	int64_t type; //SlotType
+	int64_t hint; //memory the statement touches, Ex: its pointer captures combined, 0 for none
+	int64_t size; //env bytes of a pure statement with a scalar result and no pointer captures, 0 otherwise, only those may leave the process
+};
+
+class StatementContext;
+
+//Set of addresses with a value each, open addressing that grows at half full
+//  clearing only touches used entries, so a recycled table keeps its capacity cheaply
+class AddressTable {
+public:
+	AddressTable();
+	void clear();
+	int64_t* find(const int64_t* address); //nullptr when absent
+	int64_t* insert(int64_t* address, bool& added);
+	int64_t size() const;
+	int64_t* address(const int64_t i) const; //i-th inserted address
+	int64_t value(const int64_t i) const;
+private:
+	struct Entry {
+		int64_t* address;
+		int64_t value;
+	};
+	void grow();
+	std::vector<Entry> entries;
+	std::vector<int64_t> used; //entry indices in insertion order
+	uint64_t mask;
+};
+
+//Stores through pointers of one transactional statement, buffered until it commits at recon
+//  loads see the statement's own stores first, every other load is remembered for validation
+class WriteLog {
+public:
+	WriteLog();
+	void clear();
+	void store(int64_t* address, const int64_t value);
+	int64_t load(int64_t* address);
+	bool conflicts(AddressTable& written, const uint64_t signature);
+	void commit(AddressTable& written, uint64_t& signature);
+	static WriteLog* current();
+	static WriteLog* install(WriteLog* log); //returns the log it replaces on the calling thread
+	static uint64_t bit(const int64_t* address);
+private:
+	AddressTable writes;
+	AddressTable reads;
+	uint64_t readSignature; //one bit per hashed address read, a cheap first test
+};
+
+//FORK_TRANSACTIONS switch and commit counts for FORK_REPORT
+class Transactions {
+public:
+	Transactions();
+	void configure(const bool on);
+	bool enabled() const;
+	void committed(const bool rerun);
+	void report();
+private:
+	std::atomic<int64_t> commits;
+	std::atomic<int64_t> reruns; //statements that read memory an earlier statement wrote
+	bool on;
+};
+
+//Moving average of wall time per statement function, shared by all threads
+//Lock-free and approximate, racing updates may lose a sample
+class StatementHistory {
+public:
+	StatementHistory();
+	void enable(const bool on);
+	bool enabled() const;
+	int64_t estimate(void* statement); //-1 when unknown
+	bool sample(void* statement);
+	void record(void* statement, const int64_t ns);
+	int64_t size() const;
+private:
+	struct Entry {
+		std::atomic<void*> statement;
+		std::atomic<int64_t> average; //0 until the first sample
+	};
+	Entry* find(void* statement, const bool insert);
+	Entry entries[HISTORY_ENTRIES];
+	bool on;
+};
+
+//Worker that last ran each hinted statement, direct mapped and overwritten on collision
+//  a statement is keyed by its hint, function and id in the commit, so chunk i of a pass
+//  over the same arrays lands where chunk i of the previous pass ran
+class LocalityTable {
+public:
+	LocalityTable();
+	void configure(const bool on, const bool measure);
+	int64_t key(const int64_t hint, void* statement, const int64_t id) const; //0 when untracked
+	int64_t preferred(const int64_t key); //-1 when unknown
+	void record(const int64_t key, const int64_t slot, const int64_t home);
+	void report();
+private:
+	std::atomic<int64_t> entries[LOCALITY_ENTRIES];
+	std::atomic<int64_t> placed; //statements queued with their previous worker
+	std::atomic<int64_t> kept; //placed statements that ran there
+	bool on;
+	bool measure;
+};
+
+//Spin budget from recent wait times, plus a latency histogram for FORK_REPORT
+//Shared by all threads, updates are relaxed and may lose a sample
+class WaitPolicy {
+public:
+	WaitPolicy();
+	void configure(const int64_t cpus, const bool spin, const bool measure);
+	bool timed() const; //waits only read the clock when someone uses the result
+	int64_t budget(const int64_t estimate); //0 skips spinning
+	void completed(const int64_t ns, const WaitOutcome outcome);
+	void report();
+private:
+	std::atomic<int64_t> recent; //moving average of waits that did not find the result ready
+	std::atomic<int64_t> buckets[WAIT_BUCKETS];
+	std::atomic<int64_t> outcomes[WAIT_OUTCOMES];
+	int64_t cpus;
+	bool spin;
+	bool measure;
+};
+
+//One forked statement, the slot itself is queued on the worker pool
+//  and is padded so neighbouring statements never share a cache line
+class alignas(CACHE_LINE_SIZE) StatementSlot : public PoolTask {
+public:
+	void* statement;
+	void* env;
+	SlotType type;
+	union {
+		int64_t i;
+		double f;
+		int64_t* ip;
+		double* fp;
+	} result;
+	std::atomic<int> state;
+	bool deferred; //not submitted, runs at recon
+	std::atomic<bool> cancelled; //skipped if it has not started, its result is discarded
+	std::atomic<Fiber*> waiter; //suspended fiber to wake, nullptr for a parked thread
+	StatementSlot* batch; //next short statement that runs right after this one
+	int64_t locality; //LocalityTable key, 0 for none
+	int64_t home; //slot it was placed with, -1 if none
+	int64_t envSize; //bytes of a pointer-free env, 0 keeps the statement in this process
+	WriteLog* log; //uncommitted stores of a transactional statement, nullptr otherwise
+	StatementContext* context;
+	void execute();
+	bool ready() const;
+private:
+	void run();
+	friend class StatementContext; //runs a conflicting statement again at commit
+};
+
+//Result slots of a single commit, sized once by make_context
 class StatementContext {
 public:
 	StatementContext();
-	StatementContext(StatementContext&& sc);
-	void addIntFuture(std::future<int64_t>& f, const int64_t id);
-	void addFloatFuture(std::future<double>& f, const int64_t id);
-	void addIntptrFuture(std::future<int64_t*>& f, const int64_t id);
-	void addFloatptrFuture(std::future<double*>& f, const int64_t id);
-	void addVoidFuture(std::future<void>& f, const int64_t id);
-	std::future<int64_t> getIntFuture(const int64_t id);
-	std::future<double> getFloatFuture(const int64_t id);
-	std::future<int64_t*> getIntptrFuture(const int64_t id);
-	std::future<double*> getFloatptrFuture(const int64_t id);
-	std::future<void> getVoidFuture(const int64_t id);
+	~StatementContext();
+	void reset(const int64_t statements, WorkerPool* pool, StatementHistory* history, WaitPolicy* waits,
+		LocalityTable* locality, Transactions* transactions);
+	StatementSlot* slot(const int64_t id);
+	void schedule(StatementSlot* s, void* statement, void* env, const SlotType type);
+	void run_deferred(StatementSlot* s);
+	void finish(StatementSlot* s);
+	void park(StatementSlot* s);
+	void park_any(const int64_t n);
+	void suspend(StatementSlot* s);
+	void suspend_any(const int64_t n);
+	void drain();
+	void wait(StatementSlot* s);
+	WaitOutcome spin(const int64_t first, const int64_t n, const int64_t budget);
+	bool any_ready(const int64_t first, const int64_t n);
+	int64_t plan(const int64_t n);
+	StatementSlot* planned(const int64_t task);
+	void track(StatementSlot* s);
+	void commit_through(const int64_t id);
+	StatementHistory* history;
+	WaitPolicy* waits;
+	LocalityTable* locality;
+	Transactions* transactions;
+private:
+	void commit(StatementSlot* s);
+	WorkerPool* pool;
+	StatementSlot* slots;
+	std::vector<WriteLog*> logs; //by slot id, kept with the context
+	AddressTable written; //addresses committed by this commit so far
+	uint64_t signature; //bits of written
+	int64_t uncommitted; //slots with a log
+	int64_t* order; //slot ids in scheduling order, filled by plan
+	int64_t* estimates;
+	int64_t capacity;
+	int64_t count;
+};
+
+//Contexts are recycled per thread, a context is always destroyed by the thread that made it
+class ContextCache {
+public:
+	~ContextCache();
+	StatementContext* acquire();
+	void release(StatementContext* context);
 private:
-	std::unordered_map<int64_t,std::future<int64_t>> int_future_id_map;
-	std::unordered_map<int64_t,std::future<double>> float_future_id_map;
-	std::unordered_map<int64_t,std::future<int64_t*>> intptr_future_id_map;
-	std::unordered_map<int64_t,std::future<double*>> floatptr_future_id_map;
-	std::unordered_map<int64_t,std::future<void>> void_future_id_map;
-	std::mutex map_mutex;
+	std::vector<StatementContext*> free_contexts;
 };
 
+//A cid is an opaque handle that points straight at its StatementContext
 class ParContextManager {
 public:
 	ParContextManager();
-	int64_t make_context();
+	~ParContextManager();
+	void set_max_threads(const int64_t threads);
+	int64_t get_max_threads();
+	int64_t get_numa_nodes();
+	int64_t get_numa_node();
+	int64_t get_node_cpus(const int64_t node);
+	int64_t make_context(const int64_t statements);
 	void destroy_context(const int64_t cid);
 	void sched_int(int64_t (*statement)(void*),void* env,const int64_t id,const int64_t cid);
 	void sched_float(double (*statement)(void*),void* env,const int64_t id,const int64_t cid);
@@ -61,13 +313,42 @@ public:
 	double* recon_floatptr(const double* original,const int64_t known,
 		const int64_t id,const int64_t max,const int64_t cid);
 	void recon_void(const int64_t id,const int64_t max,const int64_t cid);
+	void sched_group(const StatementDescriptor* descriptors,const int64_t n,const int64_t cid);
+	void recon_group(int64_t* results,const int64_t n,const int64_t cid);
+	int64_t recon_branch(int64_t* results,const int64_t n,const int64_t* taken,const int64_t cid);
+	bool sleep_ms(const int64_t ms);
+	void tx_store(int64_t* address,const int64_t value);
+	int64_t tx_load(int64_t* address);
+	void enter_blocking();
+	void leave_blocking();
 private:
-	void set_max_threads();
-	std::unordered_map<int64_t,StatementContext> context_map;
-	int64_t thread_count;
-	int64_t max_threads;
-	int64_t next_cid;
-	std::mutex mutex;
+	void detect_max_threads();
+	void start_pool();
+	void launch_pool();
+	void schedule(void* statement,void* env,const SlotType type,const int64_t id,const int64_t cid);
+	bool place(StatementSlot* s);
+	bool saturate(StatementSlot* s);
+	StatementSlot* await(const int64_t id,const int64_t cid);
+	static StatementContext* context_of(const int64_t cid);
+	WorkerPool pool;
+	std::once_flag pool_started;
+	std::atomic<bool> pool_ready;
+	int64_t default_threads;
+	int64_t ceiling_threads;
+	int64_t compensation_threads; //cap on workers added while others block
+	size_t stack_size; //of every worker and fiber
+	bool report;
+	bool fibers;
+	bool lazy; //statements are only published to idle workers
+	std::vector<std::vector<int> > numa_nodes;
+	PinMode pin;
+	StatementHistory history;
+	WaitPolicy waits;
+	LocalityTable locality;
+	Transactions transactions;
+	RemoteBackend remote;
+	std::string remote_peers; //FORK_REMOTE
+	SaturationPolicy saturation;
 };
 
 #endif /* __PARCONTEXTMANAGER_H */
@@ -34,7 +34,7 @@
 %token <string> TPLUS TDASH TSTAR TSLASH TLAND TDOT TSCOLON
 %token <token> TLPAREN TRPAREN TLBRACE TRBRACE TSET TNULL
 %token <token> TLSBRACE TRSBRACE TENDL TCOMMA TELSE
-%token <token> TINT TFLOAT TVOID TSTRUCT TIF TEXTERN
+%token <token> TINT TFLOAT TVOID TSTRUCT TIF TEXTERN TASYNC
 %token <token> TWHILE TRETURN UMINUS EMPTYFUNARGS
 
 //Types of grammar targets
@@ -100,8 +100,22 @@ statement : variableDec TSCOLON TENDL {
 	       $$->setCommit(false);
              }
 	     | functionDec TENDL {$$=$1;pprintf("Parser: functionDec becomes statement\n");}
+	     | TASYNC functionDec TENDL {
+		$$=$2; pprintf("Parser: async functionDec becomes statement\n");
+		((FunctionDefinition*)$2)->async = true;
+	     }
              | structDec_f TENDL {$$=$1;pprintf("Parser: structDec becomes statement\n");}
 	     | if_statement TENDL {$$=$1;}
+	     | block TENDL {
+		$$ = new BlockStatement($1);
+		$$->describe();
+		$$->setCommit(false);
+	     }
+	     | block TSCOLON TENDL {
+		$$ = new BlockStatement($1);
+		$$->describe();
+		$$->setCommit(true);
+	     }
 	     | externStatement TENDL {$$=$1;pprintf("Parser: externStatement becomes statement\n");}
 	     |
 	     rexp TSET exp TENDL {
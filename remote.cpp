@@ -0,0 +1,443 @@
+//Implementation of the multi-process statement backend
+
+#include "remote.h"
+#include "parContextManager.h"
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+/*=================================Objects=================================*/
+//FNV-1a of the file name without its directory and of the program headers
+//The main program has an empty name on every host, the headers tell two builds apart
+static uint64_t object_hash(struct dl_phdr_info* info) {
+  const char* path = info->dlpi_name ? info->dlpi_name : "";
+  const char* name = strrchr(path,'/');
+  name = name ? name + 1 : path;
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (; *name; ++name) {
+    hash = (hash ^ (unsigned char)*name) * 0x100000001B3ULL;
+  }
+  const unsigned char* headers = (const unsigned char*)info->dlpi_phdr;
+  for (size_t i = 0; i < info->dlpi_phnum*sizeof(ElfW(Phdr)); ++i) {
+    hash = (hash ^ headers[i]) * 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+//Code address inside a loaded object, by address or by object and offset
+struct ObjectQuery {
+  uintptr_t address;
+  uint64_t object;
+  int64_t offset;
+  bool found;
+};
+
+static bool executable(struct dl_phdr_info* info, const uintptr_t address) {
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    const ElfW(Phdr)& header = info->dlpi_phdr[i];
+    uintptr_t start = info->dlpi_addr + header.p_vaddr;
+    if (header.p_type == PT_LOAD && (header.p_flags & PF_X) && address >= start && address < start + header.p_memsz) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static int find_address(struct dl_phdr_info* info, size_t size, void* data) {
+  ObjectQuery* query = (ObjectQuery*)data;
+  if (!executable(info,query->address)) {
+    return 0;
+  }
+  query->object = object_hash(info);
+  query->offset = query->address - info->dlpi_addr;
+  query->found = true;
+  return 1;
+}
+
+//Resolves an offset inside executable code of the named object, serve still checks it against the entry table
+static int find_offset(struct dl_phdr_info* info, size_t size, void* data) {
+  ObjectQuery* query = (ObjectQuery*)data;
+  if (object_hash(info) != query->object) {
+    return 0;
+  }
+  uintptr_t address = info->dlpi_addr + query->offset;
+  query->found = executable(info,address);
+  query->address = address;
+  return 1;
+}
+
+//Emitted by the compiler into the program, absent from programs without forked statements
+extern "C" const RemoteEntry __fork_entries[] __attribute__((weak));
+
+//Entry points a worker runs and the type each returns, any other request is refused
+static std::unordered_map<uintptr_t,int64_t> entry_points() {
+  std::unordered_map<uintptr_t,int64_t> entries;
+  for (const RemoteEntry* e = __fork_entries; e && e->statement; ++e) {
+    entries[(uintptr_t)e->statement] = e->type;
+  }
+  return entries;
+}
+
+/*=================================Sockets=================================*/
+//host:port or just port, the host defaults to loopback
+static bool parse_address(const std::string& spec, std::string& host, std::string& port) {
+  size_t colon = spec.rfind(':');
+  host = (colon == std::string::npos || colon == 0) ? "127.0.0.1" : spec.substr(0,colon);
+  port = (colon == std::string::npos) ? spec : spec.substr(colon + 1);
+  return !port.empty();
+}
+
+static int open_socket(const std::string& host, const std::string& port, const bool listening) {
+  struct addrinfo hints;
+  memset(&hints,0,sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = listening ? AI_PASSIVE : 0;
+  struct addrinfo* found = nullptr;
+  if (getaddrinfo(host.c_str(),port.c_str(),&hints,&found)) {
+    return -1;
+  }
+  int fd = -1;
+  for (struct addrinfo* it = found; it && fd < 0; it = it->ai_next) {
+    fd = socket(it->ai_family,it->ai_socktype,it->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    int on = 1;
+    bool ok;
+    if (listening) {
+      setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+      ok = !bind(fd,it->ai_addr,it->ai_addrlen) && !listen(fd,16);
+    } else {
+      ok = !::connect(fd,it->ai_addr,it->ai_addrlen);
+    }
+    if (!ok) {
+      close(fd);
+      fd = -1;
+      continue;
+    }
+    setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+  }
+  freeaddrinfo(found);
+  return fd;
+}
+
+static bool read_full(const int fd, void* data, const size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read(fd,(char*)data + done,size - done);
+    if (n <= 0 && !(n < 0 && errno == EINTR)) {
+      return false;
+    }
+    done += std::max(n,(ssize_t)0);
+  }
+  return true;
+}
+
+static bool write_full(const int fd, const void* data, const size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = send(fd,(const char*)data + done,size - done,MSG_NOSIGNAL);
+    if (n <= 0 && !(n < 0 && errno == EINTR)) {
+      return false;
+    }
+    done += std::max(n,(ssize_t)0);
+  }
+  return true;
+}
+
+/*=================================RemoteBackend=================================*/
+RemoteBackend::RemoteBackend() {
+  pool = nullptr;
+  running.store(false);
+  turn.store(0);
+  sent.store(0);
+  returned.store(0);
+  fallbacks.store(0);
+}
+
+RemoteBackend::~RemoteBackend() {
+  running.store(false);
+  for (auto it = peerList.begin(), end = peerList.end(); it != end; ++it) {
+    Peer* p = *it;
+    uint64_t one = 1;
+    ssize_t written = write(p->wake,&one,sizeof(one));
+    (void)written;
+    p->io.join();
+    close(p->fd);
+    close(p->wake);
+    delete p;
+  }
+}
+
+//Comma separated host:port list, returns the number of peers that accepted the connection
+int64_t RemoteBackend::connect(const char* peers, WorkerPool* pool) {
+  this->pool = pool;
+  running.store(true);
+  std::string list(peers);
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t comma = list.find(',',start);
+    std::string spec = list.substr(start,(comma == std::string::npos) ? std::string::npos : comma - start);
+    start = (comma == std::string::npos) ? list.size() + 1 : comma + 1;
+    std::string host, port;
+    if (spec.empty() || !parse_address(spec,host,port)) {
+      continue;
+    }
+    int fd = open_socket(host,port,false);
+    if (fd < 0) {
+      fprintf(stderr,"Fork runtime: unable to reach worker %s, its statements run locally\n",spec.c_str());
+      continue;
+    }
+    fcntl(fd,F_SETFL,fcntl(fd,F_GETFL) | O_NONBLOCK);
+    Peer* p = new Peer();
+    p->fd = fd;
+    p->wake = eventfd(0,EFD_NONBLOCK);
+    p->next = 0;
+    p->alive.store(true);
+    peerList.push_back(p);
+    p->io = std::thread(&RemoteBackend::ioLoop,this,p);
+  }
+  return peerList.size();
+}
+
+int64_t RemoteBackend::peers() const {
+  return peerList.size();
+}
+
+//Name of a statement that worker processes can resolve, false for code they cannot have (Ex: JIT'd)
+bool RemoteBackend::identify(void* statement, uint64_t& object, int64_t& offset) {
+  std::lock_guard<std::mutex> section_monitor(identityMutex);
+  auto known = identities.find(statement);
+  if (known == identities.end()) {
+    ObjectQuery query = {(uintptr_t)statement,0,0,false};
+    dl_iterate_phdr(&find_address,&query);
+    known = identities.insert(std::make_pair(statement,std::make_pair(query.object,query.found ? query.offset : -1))).first;
+  }
+  object = known->second.first;
+  offset = known->second.second;
+  return offset >= 0;
+}
+
+//Queue the statement with the next live peer, false when the caller has to run it
+//Only scalar results are shipped back, the env is copied as it is
+//A void statement has nothing to ship back but its side effects, which belong to this process
+bool RemoteBackend::submit(StatementSlot* s, const int64_t size) {
+  if (peerList.empty() || size <= 0 || size > REMOTE_MAX_ENV) {
+    return false;
+  }
+  if (s->type != SLOT_INT && s->type != SLOT_FLOAT) {
+    return false;
+  }
+  RemoteRequest request;
+  if (!identify(s->statement,request.object,request.offset)) {
+    return false;
+  }
+  request.type = s->type;
+  request.size = size;
+  for (size_t tries = 0; tries < peerList.size(); ++tries) {
+    Peer* p = peerList[turn.fetch_add(1,std::memory_order_relaxed) % peerList.size()];
+    {
+      std::lock_guard<std::mutex> section_monitor(p->lock);
+      if (!p->alive.load()) {
+        continue;
+      }
+      request.tag = p->next++;
+      p->outgoing.insert(p->outgoing.end(),(char*)&request,(char*)&request + sizeof(request));
+      p->outgoing.insert(p->outgoing.end(),(char*)s->env,(char*)s->env + size);
+      p->inflight[request.tag] = s;
+    }
+    uint64_t one = 1;
+    ssize_t written = write(p->wake,&one,sizeof(one));
+    (void)written;
+    sent.fetch_add(1,std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+//Sends queued requests as the socket accepts them and finishes statements as replies arrive
+void RemoteBackend::ioLoop(Peer* p) {
+  std::vector<char> pending;
+  size_t written = 0;
+  std::vector<char> incoming;
+  while (running.load()) {
+    struct pollfd fds[2];
+    fds[0].fd = p->fd;
+    fds[0].events = POLLIN | ((written < pending.size()) ? POLLOUT : 0);
+    fds[1].fd = p->wake;
+    fds[1].events = POLLIN;
+    if (poll(fds,2,-1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fail(p);
+      return;
+    }
+    if (fds[1].revents & POLLIN) {
+      uint64_t count;
+      ssize_t drained = read(p->wake,&count,sizeof(count));
+      (void)drained;
+    }
+    {
+      std::lock_guard<std::mutex> section_monitor(p->lock);
+      pending.insert(pending.end(),p->outgoing.begin(),p->outgoing.end());
+      p->outgoing.clear();
+    }
+    while (written < pending.size()) {
+      ssize_t n = send(p->fd,pending.data() + written,pending.size() - written,MSG_NOSIGNAL);
+      if (n > 0) {
+        written += n;
+      } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        break;
+      } else {
+        fail(p);
+        return;
+      }
+    }
+    if (written == pending.size()) {
+      pending.clear();
+      written = 0;
+    }
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      size_t used = incoming.size();
+      incoming.resize(used + REMOTE_CHUNK);
+      ssize_t n = recv(p->fd,incoming.data() + used,REMOTE_CHUNK,0);
+      incoming.resize(used + std::max(n,(ssize_t)0));
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        fail(p);
+        return;
+      }
+      receive(p,incoming);
+    }
+  }
+}
+
+//Finish every statement with a complete reply, keep a partial one for the next read
+void RemoteBackend::receive(Peer* p, std::vector<char>& incoming) {
+  size_t used = 0;
+  while (incoming.size() - used >= sizeof(RemoteReply)) {
+    RemoteReply reply;
+    memcpy(&reply,incoming.data() + used,sizeof(reply));
+    used += sizeof(reply);
+    StatementSlot* s = nullptr;
+    {
+      std::lock_guard<std::mutex> section_monitor(p->lock);
+      auto it = p->inflight.find(reply.tag);
+      if (it != p->inflight.end()) {
+        s = it->second;
+        p->inflight.erase(it);
+      }
+    }
+    if (!s) {
+      continue;
+    }
+    if (reply.status != REMOTE_OK) {
+      fallbacks.fetch_add(1,std::memory_order_relaxed);
+      pool->submit(s);
+      continue;
+    }
+    memcpy(&s->result,&reply.result,sizeof(int64_t));
+    returned.fetch_add(1,std::memory_order_relaxed);
+    s->context->finish(s);
+  }
+  incoming.erase(incoming.begin(),incoming.begin() + used);
+}
+
+//The peer is gone, nothing new is queued with it and statements in flight run locally
+void RemoteBackend::fail(Peer* p) {
+  std::vector<StatementSlot*> orphans;
+  {
+    std::lock_guard<std::mutex> section_monitor(p->lock);
+    p->alive.store(false);
+    for (auto it = p->inflight.begin(), end = p->inflight.end(); it != end; ++it) {
+      orphans.push_back(it->second);
+    }
+    p->inflight.clear();
+    p->outgoing.clear();
+  }
+  if (running.load()) {
+    fprintf(stderr,"Fork runtime: lost a worker process, %d statements run locally\n",(int)orphans.size());
+  }
+  for (auto it = orphans.begin(), end = orphans.end(); it != end; ++it) {
+    fallbacks.fetch_add(1,std::memory_order_relaxed);
+    pool->submit(*it);
+  }
+}
+
+void RemoteBackend::report() {
+  int64_t alive = 0;
+  for (auto it = peerList.begin(), end = peerList.end(); it != end; ++it) {
+    alive += (*it)->alive.load();
+  }
+  printf("Remote workers: %d of %d alive, %lld statements sent, %lld returned, %lld ran locally\n",(int)alive,
+         (int)peerList.size(),(long long)sent.load(),(long long)returned.load(),(long long)fallbacks.load());
+}
+
+//Answer statements of one coordinator after the other, in request order, never returns
+//Statements may fork themselves, they run on this process's own pool
+//Only entry points listed in __fork_entries run, so the port must never be reachable from untrusted hosts
+void RemoteBackend::serve(const char* address) {
+  std::string host, port;
+  if (!parse_address(address,host,port)) {
+    fprintf(stderr,"Fork runtime: invalid FORK_SERVE address %s\n",address);
+    exit(1);
+  }
+  int listener = open_socket(host,port,true);
+  if (listener < 0) {
+    fprintf(stderr,"Fork runtime: unable to listen on %s:%s\n",host.c_str(),port.c_str());
+    exit(1);
+  }
+  std::unordered_map<uintptr_t,int64_t> entries = entry_points();
+  fprintf(stderr,"Fork worker listening on %s:%s, %d statements\n",host.c_str(),port.c_str(),(int)entries.size());
+  alignas(16) char env[REMOTE_MAX_ENV];
+  while (true) {
+    int fd = accept(listener,nullptr,nullptr);
+    if (fd < 0) {
+      continue;
+    }
+    int on = 1;
+    setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+    RemoteRequest request;
+    while (read_full(fd,&request,sizeof(request))) {
+      if (request.size > REMOTE_MAX_ENV || !read_full(fd,env,request.size)) {
+        break;
+      }
+      ObjectQuery query = {0,request.object,request.offset,false};
+      dl_iterate_phdr(&find_offset,&query);
+      auto entry = query.found ? entries.find(query.address) : entries.end();
+      bool listed = entry != entries.end() && entry->second == request.type;
+      RemoteReply reply = {request.tag,listed ? REMOTE_OK : REMOTE_UNKNOWN,0};
+      if (listed) {
+        void* statement = (void*)query.address;
+        switch (request.type) {
+          case SLOT_INT:
+            reply.result = ((int64_t (*)(void*))statement)(env);
+            break;
+          case SLOT_FLOAT: {
+            double f = ((double (*)(void*))statement)(env);
+            memcpy(&reply.result,&f,sizeof(f));
+            break;
+          }
+          default: //void statements are never shipped
+            reply.status = REMOTE_UNKNOWN;
+        }
+      }
+      if (!write_full(fd,&reply,sizeof(reply))) {
+        break;
+      }
+    }
+    close(fd);
+  }
+}
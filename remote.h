@@ -0,0 +1,90 @@
+//Multi-process execution of forked statements with scalar environments
+
+//DO NOT USE GC HERE --- not compatible with C++11 <thread>
+
+#ifndef __REMOTE_H
+#define __REMOTE_H
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <stdint.h>
+#include "workerPool.h"
+
+//Larger environments are not worth shipping and run locally
+#define REMOTE_MAX_ENV 4096
+//Bytes read from a socket at once
+#define REMOTE_CHUNK 65536
+
+class StatementSlot;
+
+//Every worker process runs the same program, so a statement is named by its offset
+//  inside the loaded object that contains it, the object by a hash of its file name and layout
+struct RemoteRequest {
+	uint64_t tag; //echoed in the reply
+	uint64_t object;
+	int64_t offset;
+	int32_t type; //SlotType
+	uint32_t size; //env bytes that follow
+};
+
+//Statements a worker process agrees to run, the compiler lists every forked statement it may ship
+//  in the table __fork_entries of the program, ended by an entry with a null statement
+struct RemoteEntry {
+	void* statement;
+	int64_t type; //SlotType the statement was compiled for
+};
+
+struct RemoteReply {
+	uint64_t tag;
+	int64_t status; //REMOTE_OK or REMOTE_UNKNOWN
+	int64_t result; //bit pattern of the int or float result
+};
+
+enum RemoteStatus {
+	REMOTE_OK,
+	REMOTE_UNKNOWN //the worker does not list the statement with that type, the coordinator runs it
+};
+
+//Coordinator side: statements are streamed to worker processes over TCP and
+//  finished from one I/O thread per peer when their reply arrives
+//A peer that fails hands its statements in flight back to the local pool
+//Worker side: serve answers requests of one coordinator at a time, in order
+class RemoteBackend {
+public:
+	RemoteBackend();
+	~RemoteBackend();
+	int64_t connect(const char* peers, WorkerPool* pool);
+	int64_t peers() const;
+	bool submit(StatementSlot* s, const int64_t size);
+	void report();
+	static void serve(const char* address);
+private:
+	struct Peer {
+		int fd; //non-blocking socket
+		int wake; //eventfd, written when outgoing grows
+		std::thread io;
+		std::mutex lock;
+		std::vector<char> outgoing;
+		std::unordered_map<uint64_t,StatementSlot*> inflight;
+		uint64_t next; //tag of the next request
+		std::atomic<bool> alive;
+	};
+	void ioLoop(Peer* p);
+	void receive(Peer* p, std::vector<char>& incoming);
+	void fail(Peer* p);
+	bool identify(void* statement, uint64_t& object, int64_t& offset);
+	std::vector<Peer*> peerList;
+	WorkerPool* pool;
+	std::atomic<bool> running;
+	std::atomic<int64_t> turn;
+	std::atomic<int64_t> sent;
+	std::atomic<int64_t> returned;
+	std::atomic<int64_t> fallbacks;
+	std::mutex identityMutex;
+	std::unordered_map<void*,std::pair<uint64_t,int64_t> > identities;
+};
+
+#endif /* __REMOTE_H */
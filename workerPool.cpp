@@ -0,0 +1,785 @@
+//Implementation of the work-stealing worker pool
+
+#include "workerPool.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <stdio.h>
+#include <sched.h>
+#include <pthread.h>
+
+//Slot of the calling thread in the pool it last registered with
+static thread_local WorkerPool* local_pool = nullptr;
+static thread_local int64_t local_slot = -1;
+static thread_local uint64_t local_seed = 0;
+static thread_local int64_t local_blocking = 0; //nesting depth of blocking regions
+
+//Cheap per-thread xorshift generator for choosing victims
+//Never inlined, loop fibers may resume on a new thread and must not reuse a stale thread local address
+__attribute__((noinline)) static uint64_t next_random() {
+  if (!local_seed) {
+    local_seed = (uint64_t)(uintptr_t)&local_seed | 1;
+  }
+  local_seed ^= local_seed << 13;
+  local_seed ^= local_seed >> 7;
+  local_seed ^= local_seed << 17;
+  return local_seed;
+}
+
+/*=================================PoolTask=================================*/
+PoolTask::~PoolTask() {
+  //Do nothing
+}
+
+/*=================================Inbox=================================*/
+Inbox::Inbox() {
+  size.store(0);
+  open.store(false);
+}
+
+/*=============================WorkStealingDeque=============================*/
+WorkStealingDeque::Buffer::Buffer(const int64_t capacity) {
+  this->capacity = capacity;
+  slots = new std::atomic<PoolTask*>[capacity];
+}
+
+WorkStealingDeque::Buffer::~Buffer() {
+  delete[] slots;
+}
+
+PoolTask* WorkStealingDeque::Buffer::get(const int64_t i) const {
+  return slots[i & (capacity-1)].load(std::memory_order_relaxed);
+}
+
+void WorkStealingDeque::Buffer::put(const int64_t i, PoolTask* task) {
+  slots[i & (capacity-1)].store(task,std::memory_order_relaxed);
+}
+
+WorkStealingDeque::WorkStealingDeque() {
+  top.store(0,std::memory_order_relaxed);
+  bottom.store(0,std::memory_order_relaxed);
+  buffer.store(new Buffer(64),std::memory_order_relaxed);
+}
+
+WorkStealingDeque::~WorkStealingDeque() {
+  delete buffer.load(std::memory_order_relaxed);
+  for (auto it = retired.begin(), end = retired.end(); it != end; ++it) {
+    delete *it;
+  }
+}
+
+WorkStealingDeque::Buffer* WorkStealingDeque::grow(Buffer* old, const int64_t bottom, const int64_t top) {
+  Buffer* bigger = new Buffer(old->capacity*2);
+  for (int64_t i = top; i != bottom; ++i) {
+    bigger->put(i,old->get(i));
+  }
+  retired.push_back(old);
+  buffer.store(bigger,std::memory_order_release);
+  return bigger;
+}
+
+//Owner only
+void WorkStealingDeque::push(PoolTask* task) {
+  int64_t b = bottom.load(std::memory_order_relaxed);
+  int64_t t = top.load(std::memory_order_acquire);
+  Buffer* a = buffer.load(std::memory_order_relaxed);
+  if (b - t > a->capacity - 1) {
+    a = grow(a,b,t);
+  }
+  a->put(b,task);
+  bottom.store(b+1,std::memory_order_release); //publish the task to thieves
+}
+
+//Owner only, returns the most recently pushed task
+PoolTask* WorkStealingDeque::take() {
+  int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+  Buffer* a = buffer.load(std::memory_order_relaxed);
+  bottom.store(b,std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top.load(std::memory_order_relaxed);
+  PoolTask* task = nullptr;
+  if (t <= b) {
+    task = a->get(b);
+    if (t == b) { //last element, race against thieves
+      if (!top.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed)) {
+        task = nullptr;
+      }
+      bottom.store(b+1,std::memory_order_relaxed);
+    }
+  } else {
+    bottom.store(b+1,std::memory_order_relaxed);
+  }
+  return task;
+}
+
+//Any thread, returns the oldest task or nullptr if empty or the race was lost
+PoolTask* WorkStealingDeque::steal() {
+  int64_t t = top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = bottom.load(std::memory_order_acquire);
+  if (t < b) {
+    Buffer* a = buffer.load(std::memory_order_acquire);
+    PoolTask* task = a->get(t);
+    if (!top.compare_exchange_strong(t,t+1,std::memory_order_seq_cst,std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return task;
+  }
+  return nullptr;
+}
+
+//Any thread, only an estimate while others push or steal
+int64_t WorkStealingDeque::size() const {
+  int64_t b = bottom.load(std::memory_order_relaxed);
+  int64_t t = top.load(std::memory_order_relaxed);
+  return std::max(b - t,(int64_t)0);
+}
+
+/*================================WorkerPool================================*/
+WorkerPool::WorkerPool() {
+  ceiling = 0;
+  fibers = false;
+  pin = PIN_NONE;
+  limit.store(0);
+  live.store(0);
+  slotCount.store(0);
+  epoch.store(0);
+  sleepers.store(0);
+  waking.store(false);
+  searching.store(0);
+  compensation = 0;
+  stackSize = FIBER_STACK_SIZE;
+  blocked.store(0);
+  blockings.store(0);
+  running.store(false);
+  spawned = 0;
+  retired = 0;
+  peak = 0;
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> spawn_monitor(spawnMutex); //no worker spawns after this
+    std::lock_guard<std::mutex> section_monitor(parkMutex);
+    running.store(false);
+  }
+  parkCondition.notify_all();
+  for (size_t slot = 0; slot < threads.size(); ++slot) {
+    if (joinable[slot]) {
+      pthread_join(threads[slot],nullptr);
+    }
+  }
+  for (size_t slot = 0; slot < stacks.size(); ++slot) {
+    if (stacks[slot]) {
+      unmap_stack(stacks[slot],stackSize);
+    }
+  }
+  for (auto it = deques.begin(), end = deques.end(); it != end; ++it) {
+    delete *it;
+  }
+  for (auto it = inboxes.begin(), end = inboxes.end(); it != end; ++it) {
+    delete *it;
+  }
+  for (auto it = schedulers.begin(), end = schedulers.end(); it != end; ++it) {
+    delete *it;
+  }
+}
+
+//Must be called before start, without it the pool sees one node and never pins
+void WorkerPool::place(const std::vector<std::vector<int> >& nodes, const PinMode pin) {
+  if (running.load()) {
+    return;
+  }
+  this->nodes = nodes;
+  this->pin = nodes.empty() ? PIN_NONE : pin;
+}
+
+//The ceiling bounds every later limit, compensation workers and external threads register behind the workers
+void WorkerPool::start(const int64_t limit, const int64_t ceiling, const int64_t compensation, const bool fibers,
+    const size_t stackSize) {
+  if (running.load()) {
+    return;
+  }
+  this->ceiling = std::max(ceiling,limit);
+  this->fibers = fibers;
+  this->compensation = std::max(compensation,(int64_t)0);
+  this->stackSize = stackSize;
+  for (int64_t i = 0; i < this->ceiling + this->compensation + MAX_EXTERNAL_THREADS; ++i) {
+    deques.push_back(new WorkStealingDeque());
+    inboxes.push_back(new Inbox());
+  }
+  threads.resize(deques.size());
+  joinable.resize(deques.size(),0);
+  stacks.resize(deques.size(),nullptr);
+  workerSlots.resize(deques.size(),0);
+  schedulers.resize(deques.size(),nullptr);
+  slotNodes = std::vector<std::atomic<int64_t> >(deques.size());
+  for (auto it = slotNodes.begin(), end = slotNodes.end(); it != end; ++it) {
+    it->store(0,std::memory_order_relaxed);
+  }
+  slotCpus.resize(deques.size(),-1);
+  nodeWorkers.resize(std::max(nodes.size(),(size_t)1),0);
+  int cpus = 0;
+  for (auto it = nodes.begin(), end = nodes.end(); it != end; ++it) {
+    for (auto cpu = it->begin(), last = it->end(); cpu != last; ++cpu) {
+      cpus = std::max(cpus,*cpu + 1);
+    }
+  }
+  cpuTaken.resize(cpus,0);
+  this->limit.store(std::max(limit,(int64_t)1));
+  running.store(true);
+}
+
+void WorkerPool::setLimit(const int64_t limit) {
+  this->limit.store(std::min(std::max(limit,(int64_t)1),ceiling));
+  std::lock_guard<std::mutex> section_monitor(parkMutex);
+  parkCondition.notify_all(); //surplus workers retire
+}
+
+int64_t WorkerPool::getLimit() const {
+  return limit.load();
+}
+
+int64_t WorkerPool::getCeiling() const {
+  return ceiling;
+}
+
+//Live workers the pool may have right now, blocked ones are replaced up to the cap
+int64_t WorkerPool::allowed() const {
+  return limit.load() + std::min(blocked.load(),compensation);
+}
+
+//Number of live workers
+int64_t WorkerPool::size() const {
+  return live.load();
+}
+
+void WorkerPool::report() const {
+  printf("Worker pool: limit %d, ceiling %d, live %d, peak %d, spawned %d, retired %d\n",
+         (int)limit.load(),(int)ceiling,(int)live.load(),(int)peak,(int)spawned,(int)retired);
+  printf("Blocking regions: %d, compensation cap %d\n",(int)blockings.load(),(int)compensation);
+  for (size_t node = 0; node < nodeWorkers.size() && nodes.size() > 1; ++node) {
+    printf("  node %d: %d workers\n",(int)node,(int)nodeWorkers[node]);
+  }
+}
+
+int64_t WorkerPool::localSlot() {
+  if (local_pool != this) {
+    int64_t slot = slotCount.fetch_add(1);
+    if (slot >= (int64_t)deques.size()) {
+      return -1; //no free deque, caller runs work inline
+    }
+    local_pool = this;
+    local_slot = slot;
+    slotNodes[slot].store(std::max(cpuNode(sched_getcpu()),(int64_t)0),std::memory_order_relaxed);
+    watch_stack_overflow(stackSize,false);
+    if (fibers) {
+      schedulers[slot] = new FiberScheduler(&WorkerPool::fiberLoop,this,stackSize);
+      schedulers[slot]->attach();
+    }
+  }
+  return local_slot;
+}
+
+void WorkerPool::submit(PoolTask* task) {
+  if (!enqueue(task)) {
+    task->execute();
+    return;
+  }
+  signal(1);
+}
+
+//Queue a task without waking anyone, false when the caller has no deque and must run it
+bool WorkerPool::enqueue(PoolTask* task) {
+  int64_t slot = localSlot();
+  if (slot < 0) {
+    return false;
+  }
+  deques[slot]->push(task);
+  return true;
+}
+
+//Queue a task with the worker on slot, in the caller's own deque when that worker is gone or is the caller
+bool WorkerPool::enqueueAt(PoolTask* task, const int64_t slot) {
+  if (slot < 0 || slot >= (int64_t)inboxes.size() || slot == currentSlot() || !inboxes[slot]->open.load()) {
+    return enqueue(task);
+  }
+  Inbox* inbox = inboxes[slot];
+  std::lock_guard<std::mutex> section_monitor(inbox->lock);
+  inbox->tasks.push_back(task);
+  inbox->size.fetch_add(1);
+  return true;
+}
+
+//Slot of the calling thread, -1 when it never touched the pool
+int64_t WorkerPool::currentSlot() {
+  return (local_pool == this) ? local_slot : -1;
+}
+
+//Wake parked workers or add new ones for tasks queued with enqueue
+void WorkerPool::signal(const int64_t tasks) {
+  epoch.fetch_add(1);
+  int64_t idle = sleepers.load();
+  if (idle > 0) {
+    std::lock_guard<std::mutex> section_monitor(parkMutex);
+    waking.store(true);
+    if (tasks >= idle) {
+      parkCondition.notify_all();
+    } else {
+      for (int64_t i = 0; i < tasks; ++i) {
+        parkCondition.notify_one();
+      }
+    }
+  }
+  int64_t slot = (local_pool == this) ? local_slot : -1;
+  for (int64_t i = idle; i < tasks && slot >= 0; ++i) {
+    if (live.load() >= allowed() || deques[slot]->size() <= idle) {
+      break;
+    }
+    grow(); //more queued work than parked workers
+  }
+}
+
+//Lazy signal, free while every worker is busy and none can be added
+//  the tasks stay stealable and the owner runs them at recon unless a worker goes idle first
+//Nobody is woken while a worker searches or a wakeup is in flight, they find these tasks as well
+//The fence pairs with the sleeper count, the waking flag and the searcher count,
+//  a parking, woken or searching worker either is seen here or sees the tasks
+void WorkerPool::offer(const int64_t tasks) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepers.load(std::memory_order_relaxed) == 0 && live.load(std::memory_order_relaxed) >= allowed()) {
+    return;
+  }
+  if (waking.load(std::memory_order_relaxed) || searching.load(std::memory_order_relaxed) > 0) {
+    return;
+  }
+  signal(tasks);
+}
+
+//Every worker is busy, none can be added, and the caller already queued enough to feed them
+bool WorkerPool::saturated() {
+  int64_t workers = live.load();
+  if (sleepers.load() > 0 || workers < allowed()) {
+    return false;
+  }
+  int64_t slot = localSlot();
+  return slot < 0 || deques[slot]->size() >= workers;
+}
+
+void WorkerPool::grow() {
+  std::lock_guard<std::mutex> section_monitor(spawnMutex);
+  if (!running.load() || live.load() >= allowed()) {
+    return;
+  }
+  int64_t slot;
+  if (!freeSlots.empty()) {
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+  } else {
+    slot = slotCount.fetch_add(1);
+    if (slot >= (int64_t)deques.size()) {
+      return;
+    }
+  }
+  if (joinable[slot]) {
+    pthread_join(threads[slot],nullptr); //previous owner already retired
+    joinable[slot] = 0;
+  }
+  if (!stacks[slot]) {
+    stacks[slot] = map_stack(stackSize);
+    assert(stacks[slot] && "Unable to map worker stack");
+  }
+  workerSlots[slot] = 1;
+  int64_t node = std::min_element(nodeWorkers.begin(),nodeWorkers.end()) - nodeWorkers.begin();
+  ++nodeWorkers[node];
+  slotNodes[slot].store(node,std::memory_order_relaxed);
+  slotCpus[slot] = -1;
+  if (pin == PIN_CORE) {
+    const std::vector<int>& cpus = nodes[node];
+    int cpu = cpus[(nodeWorkers[node] - 1) % cpus.size()]; //shared only when a node has more workers than CPUs
+    for (auto it = cpus.begin(), end = cpus.end(); it != end; ++it) {
+      if (!cpuTaken[*it]) {
+        cpu = *it;
+        break;
+      }
+    }
+    cpuTaken[cpu] = 1;
+    slotCpus[slot] = cpu;
+  }
+  inboxes[slot]->open.store(true);
+  live.fetch_add(1);
+  ++spawned;
+  peak = std::max(peak,live.load());
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr,stacks[slot],stackSize);
+  std::pair<WorkerPool*,int64_t>* start = new std::pair<WorkerPool*,int64_t>(this,slot);
+  int failed = pthread_create(&threads[slot],&attr,&WorkerPool::workerEntry,start);
+  pthread_attr_destroy(&attr);
+  assert(!failed && "Unable to start worker thread");
+  joinable[slot] = 1;
+}
+
+//Only called with an empty deque, the last worker stays unless it is over the limit
+bool WorkerPool::retire(const int64_t slot, const bool idle) {
+  std::lock_guard<std::mutex> section_monitor(spawnMutex);
+  int64_t workers = live.load();
+  if (!(workers > allowed() || (idle && workers > 1))) {
+    return false;
+  }
+  inboxes[slot]->open.store(false); //placements that raced with this are stolen
+  live.fetch_sub(1);
+  ++retired;
+  --nodeWorkers[slotNodes[slot].load(std::memory_order_relaxed)];
+  if (slotCpus[slot] >= 0) {
+    cpuTaken[slotCpus[slot]] = 0;
+  }
+  freeSlots.push_back(slot);
+  return true;
+}
+
+//Run one task previously submitted by the calling thread, false if none is left
+bool WorkerPool::runPending() {
+  if (local_pool != this) {
+    return false;
+  }
+  PoolTask* task = deques[local_slot]->take();
+  if (!task) {
+    return false;
+  }
+  task->execute();
+  return true;
+}
+
+//Run one task while waiting on a result, own tasks first and stolen ones after
+//False when there was nothing to run anywhere
+bool WorkerPool::help() {
+  if (runPending()) {
+    return true;
+  }
+  PoolTask* task = stealWork((local_pool == this) ? local_slot : -1);
+  if (!task) {
+    return false;
+  }
+  task->execute();
+  return true;
+}
+
+//Sweep the deques of the thief's own node first, then the remote ones, starting at a random victim
+PoolTask* WorkerPool::stealWork(const int64_t slot) {
+  int64_t slots = std::min(slotCount.load(),(int64_t)deques.size());
+  if (slots <= 0) {
+    return nullptr;
+  }
+  int64_t start = next_random() % slots;
+  int64_t home = (slot >= 0 && nodes.size() > 1) ? slotNodes[slot].load(std::memory_order_relaxed) : -1;
+  for (int64_t pass = (home < 0); pass < 2; ++pass) {
+    for (int64_t i = 0; i < slots; ++i) {
+      int64_t victim = (start + i) % slots;
+      if (victim == slot) {
+        continue;
+      }
+      if (home >= 0 && (slotNodes[victim].load(std::memory_order_relaxed) == home) != (pass == 0)) {
+        continue;
+      }
+      if (PoolTask* task = deques[victim]->steal()) {
+        return task;
+      }
+      if (PoolTask* task = takeInbox(victim)) {
+        return task;
+      }
+    }
+  }
+  return nullptr;
+}
+
+PoolTask* WorkerPool::findWork(const int64_t slot) {
+  if (PoolTask* task = deques[slot]->take()) {
+    return task;
+  }
+  if (PoolTask* task = takeInbox(slot)) {
+    return task;
+  }
+  return stealWork(slot);
+}
+
+//Oldest placement first, the lock is skipped while the inbox is empty
+PoolTask* WorkerPool::takeInbox(const int64_t slot) {
+  Inbox* inbox = inboxes[slot];
+  if (inbox->size.load() <= 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> section_monitor(inbox->lock);
+  if (inbox->tasks.empty()) {
+    return nullptr;
+  }
+  PoolTask* task = inbox->tasks.front();
+  inbox->tasks.pop_front();
+  inbox->size.fetch_sub(1);
+  return task;
+}
+
+//Keep looking for a while before parking, yielding the CPU between rounds
+//  so a forker on the same core keeps running, stops early once a fiber is woken
+PoolTask* WorkerPool::search(const int64_t slot) {
+  FiberScheduler* sched = schedulers[slot];
+  PoolTask* task = nullptr;
+  searching.fetch_add(1);
+  for (int64_t i = 0; i < WORKER_SEARCH_ROUNDS && !task && running.load(); ++i) {
+    if (sched && sched->hasReady()) {
+      break;
+    }
+    std::this_thread::yield();
+    task = findWork(slot);
+  }
+  searching.fetch_sub(1);
+  return task;
+}
+
+//No fiber of the thread is waiting for anything
+bool WorkerPool::quiet(FiberScheduler* sched) const {
+  return !sched || (!sched->suspended && !sched->hasReady() && !sched->hasTimers());
+}
+
+//Sleep until new work is submitted, a fiber is woken or a timer expires
+//Returns false once the worker retired, external threads never retire
+bool WorkerPool::park(const int64_t slot) {
+  FiberScheduler* sched = schedulers[slot];
+  bool worker = workerSlots[slot];
+  if (worker && quiet(sched) && live.load() > allowed() && retire(slot,false)) {
+    return false;
+  }
+  sleepers.fetch_add(1);
+  int64_t seen = epoch.load();
+  if (PoolTask* task = stealWork(slot)) {
+    sleepers.fetch_sub(1);
+    task->execute();
+    return true;
+  }
+  if (sched && sched->hasReady()) {
+    sleepers.fetch_sub(1);
+    return true;
+  }
+  bool idle = false;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(WORKER_IDLE_MS);
+  bool timer = sched && sched->hasTimers() && sched->nextTimer() < deadline;
+  if (timer) {
+    deadline = sched->nextTimer();
+  }
+  std::unique_lock<std::mutex> lock(parkMutex);
+  while ((running.load() || !quiet(sched)) && epoch.load() == seen && (!worker || live.load() <= allowed())) {
+    if (parkCondition.wait_until(lock,deadline) == std::cv_status::timeout) {
+      idle = !timer && epoch.load() == seen;
+      break;
+    }
+  }
+  lock.unlock();
+  waking.store(false); //before looking for work, see offer
+  sleepers.fetch_sub(1);
+  if (worker && quiet(sched) && (idle || live.load() > allowed()) && running.load()) {
+    return !retire(slot,idle);
+  }
+  return true;
+}
+
+//Workers run on stacks of stackSize with a guard page below, see map_stack
+void* WorkerPool::workerEntry(void* start) {
+  std::pair<WorkerPool*,int64_t>* args = (std::pair<WorkerPool*,int64_t>*)start;
+  WorkerPool* pool = args->first;
+  int64_t slot = args->second;
+  delete args;
+  pool->workerLoop(slot);
+  return nullptr;
+}
+
+void WorkerPool::workerLoop(const int64_t slot) {
+  local_pool = this;
+  local_slot = slot;
+  pinWorker(slot);
+  watch_stack_overflow(stackSize,true);
+  if (fibers) {
+    if (!schedulers[slot]) {
+      schedulers[slot] = new FiberScheduler(&WorkerPool::fiberLoop,this,stackSize);
+    }
+    schedulers[slot]->attach();
+  }
+  runLoop(slot);
+  unwatch_stack_overflow();
+  local_pool = nullptr;
+}
+
+//Entry of every new loop fiber, runs on the thread that created it
+void WorkerPool::fiberLoop(void* pool) {
+  WorkerPool* self = (WorkerPool*)pool;
+  self->runLoop(local_slot);
+}
+
+//Resume woken fibers first, then run tasks, then park
+//A worker leaves only from its root fiber, so a loop fiber that decides to exit hands over to the root
+//Uses no thread locals directly, an idle loop fiber may be resumed by the next worker of the slot
+void WorkerPool::runLoop(const int64_t slot) {
+  FiberScheduler* sched = schedulers[slot];
+  bool worker = workerSlots[slot];
+  while (true) {
+    if (sched) {
+      Fiber* self = sched->running();
+      if (self->exiting) {
+        return;
+      }
+      sched->pollTimers();
+      if (Fiber* next = sched->popReady()) {
+        if (next != self) {
+          sched->idle(self); //loop fibers are interchangeable, park this one at the loop top
+          sched->switchTo(next);
+        }
+        continue;
+      }
+    }
+    bool exit = false;
+    if (worker && !running.load() && quiet(sched)) {
+      exit = true;
+    } else if (PoolTask* task = findWork(slot)) {
+      task->execute();
+    } else if (PoolTask* task = search(slot)) {
+      task->execute();
+    } else if (!park(slot)) {
+      exit = true;
+    }
+    if (!exit) {
+      continue;
+    }
+    if (!sched || sched->running() == sched->getRoot()) {
+      return;
+    }
+    Fiber* root = sched->getRoot();
+    sched->unidle(root);
+    root->exiting = true;
+    sched->idle(sched->running());
+    sched->switchTo(root);
+  }
+}
+
+/*================================Topology================================*/
+//Pinning is best effort, a CPU that left the affinity mask just leaves the worker floating
+void WorkerPool::pinWorker(const int64_t slot) {
+  if (pin == PIN_NONE) {
+    return;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pin == PIN_CORE) {
+    CPU_SET(slotCpus[slot],&set);
+  } else {
+    const std::vector<int>& cpus = nodes[slotNodes[slot].load(std::memory_order_relaxed)];
+    for (auto it = cpus.begin(), end = cpus.end(); it != end; ++it) {
+      CPU_SET(*it,&set);
+    }
+  }
+  pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+}
+
+//Node of a CPU, -1 when the CPU is unknown
+int64_t WorkerPool::cpuNode(const int cpu) const {
+  for (size_t node = 0; node < nodes.size(); ++node) {
+    if (std::find(nodes[node].begin(),nodes[node].end(),cpu) != nodes[node].end()) {
+      return node;
+    }
+  }
+  return -1;
+}
+
+int64_t WorkerPool::nodeCount() const {
+  return std::max(nodes.size(),(size_t)1);
+}
+
+int64_t WorkerPool::nodeCpus(const int64_t node) const {
+  if (node < 0 || node >= (int64_t)nodes.size()) {
+    return 0;
+  }
+  return nodes[node].size();
+}
+
+//Node the calling thread runs on, the home node for a worker
+int64_t WorkerPool::currentNode() {
+  if (local_pool == this && workerSlots[local_slot]) {
+    return slotNodes[local_slot].load(std::memory_order_relaxed);
+  }
+  return std::max(cpuNode(sched_getcpu()),(int64_t)0);
+}
+
+/*================================Fibers================================*/
+//Never inlined for the same reason as next_random
+__attribute__((noinline)) FiberScheduler* WorkerPool::localScheduler() {
+  return (local_pool == this) ? schedulers[local_slot] : nullptr;
+}
+
+//The calling thread runs on fibers and may suspend
+bool WorkerPool::suspendable() {
+  return fibers && localScheduler();
+}
+
+Fiber* WorkerPool::currentFiber() {
+  return localScheduler()->running();
+}
+
+//Switch away from the calling fiber until wake is called for it
+//The caller must register itself with whatever will wake it before blocking
+void WorkerPool::block() {
+  FiberScheduler* sched = localScheduler();
+  Fiber* next = sched->popReady();
+  if (!next) {
+    next = sched->loopFiber();
+  }
+  ++sched->suspended;
+  sched->switchTo(next);
+  --sched->suspended;
+}
+
+//Any thread, the fiber resumes on its own thread
+void WorkerPool::wake(Fiber* f) {
+  f->owner->wake(f);
+  epoch.fetch_add(1);
+  if (sleepers.load() > 0) {
+    std::lock_guard<std::mutex> section_monitor(parkMutex);
+    parkCondition.notify_all(); //the owner may be any of the sleepers
+  }
+}
+
+//The calling worker is about to block its thread, hand its share of the limit to a new worker
+//  unless a parked one can take the queued work, nested regions count once
+void WorkerPool::enterBlocking() {
+  if (local_pool != this || !workerSlots[local_slot] || local_blocking++) {
+    return;
+  }
+  blocked.fetch_add(1);
+  blockings.fetch_add(1,std::memory_order_relaxed);
+  if (sleepers.load() == 0 && live.load() < allowed()) {
+    grow();
+  }
+}
+
+//Surplus workers retire the next time they run out of work
+void WorkerPool::leaveBlocking() {
+  if (local_pool != this || !workerSlots[local_slot] || --local_blocking) {
+    return;
+  }
+  blocked.fetch_sub(1);
+  if (sleepers.load() > 0 && live.load() > allowed()) {
+    std::lock_guard<std::mutex> section_monitor(parkMutex);
+    parkCondition.notify_all();
+  }
+}
+
+//Suspend the calling fiber for ms milliseconds, false when the caller is not on a fiber
+bool WorkerPool::sleepFor(const int64_t ms) {
+  if (!suspendable()) {
+    return false;
+  }
+  FiberScheduler* sched = localScheduler();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  while (std::chrono::steady_clock::now() < deadline) {
+    sched->addTimer(deadline,sched->running());
+    block();
+  }
+  return true;
+}
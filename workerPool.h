@@ -0,0 +1,170 @@
+//Pool of worker threads with work-stealing deques that grows and shrinks with demand
+
+//DO NOT USE GC HERE --- not compatible with C++11 <thread>
+
+#ifndef __WORKERPOOL_H
+#define __WORKERPOOL_H
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <stdint.h>
+#include <pthread.h>
+#include "fiber.h"
+
+//Threads that are not workers (Ex: main) may also submit work
+#define MAX_EXTERNAL_THREADS 64
+
+//A worker parked this long without work retires, the pool regrows on demand
+#define WORKER_IDLE_MS 200
+//Rounds a worker that ran out of work keeps looking before it parks
+#define WORKER_SEARCH_ROUNDS 64
+
+//How workers are bound to the CPUs of their NUMA node
+enum PinMode {
+	PIN_NONE, //the OS places workers freely
+	PIN_CORE, //one CPU per worker
+	PIN_NODE //any CPU of the worker's node
+};
+
+//Unit of work owned by its submitter, the pool never touches it again once execute returns
+class PoolTask {
+public:
+	virtual ~PoolTask();
+	virtual void execute() =0;
+};
+
+//Chase-Lev deque: the owner pushes and takes at the bottom, thieves steal from the top
+class WorkStealingDeque {
+public:
+	WorkStealingDeque();
+	~WorkStealingDeque();
+	void push(PoolTask* task);
+	PoolTask* take();
+	PoolTask* steal();
+	int64_t size() const;
+private:
+	struct Buffer {
+		int64_t capacity; //always a power of two
+		std::atomic<PoolTask*>* slots;
+		Buffer(const int64_t capacity);
+		~Buffer();
+		PoolTask* get(const int64_t i) const;
+		void put(const int64_t i, PoolTask* task);
+	};
+	Buffer* grow(Buffer* old, const int64_t bottom, const int64_t top);
+	std::atomic<int64_t> top;
+	char pad0[64]; //keep thieves and owner on separate cache lines
+	std::atomic<int64_t> bottom;
+	char pad1[64];
+	std::atomic<Buffer*> buffer;
+	std::vector<Buffer*> retired; //thieves may still read old buffers, free on destruction
+};
+
+//Tasks placed with one worker for cache locality, the owner takes them before stealing
+//  and thieves take them once the owner is busy, so a placement is only a preference
+struct Inbox {
+	std::mutex lock;
+	std::deque<PoolTask*> tasks;
+	std::atomic<int64_t> size;
+	std::atomic<bool> open; //a live worker owns the slot
+	Inbox();
+};
+
+//Every thread that submits work owns one deque, idle workers steal from random victims
+//Workers are spawned while work is submitted and nobody is parked, up to the limit
+//  and retire once they idled for WORKER_IDLE_MS or the limit dropped below them
+//With fibers, every registered thread runs tasks on its own fibers: a blocked task suspends
+//  its fiber and the thread keeps running the loop on another one until it is woken
+//Workers are spread evenly over the NUMA nodes and steal from their own node first
+//A worker inside a blocking region does not count against the limit,
+//  up to the compensation cap extra workers keep the pool at full parallelism meanwhile
+class WorkerPool {
+public:
+	WorkerPool();
+	~WorkerPool();
+	void place(const std::vector<std::vector<int> >& nodes, const PinMode pin);
+	void start(const int64_t limit, const int64_t ceiling, const int64_t compensation, const bool fibers,
+		const size_t stackSize);
+	void submit(PoolTask* task);
+	bool enqueue(PoolTask* task);
+	bool enqueueAt(PoolTask* task, const int64_t slot);
+	int64_t currentSlot();
+	void signal(const int64_t tasks);
+	void offer(const int64_t tasks);
+	bool runPending();
+	bool help();
+	bool suspendable();
+	Fiber* currentFiber();
+	void block();
+	void wake(Fiber* f);
+	bool sleepFor(const int64_t ms);
+	void enterBlocking();
+	void leaveBlocking();
+	bool saturated();
+	void setLimit(const int64_t limit);
+	int64_t getLimit() const;
+	int64_t getCeiling() const;
+	int64_t size() const;
+	int64_t nodeCount() const;
+	int64_t nodeCpus(const int64_t node) const;
+	int64_t currentNode();
+	void report() const;
+private:
+	static void* workerEntry(void* start);
+	void workerLoop(const int64_t slot);
+	void runLoop(const int64_t slot);
+	static void fiberLoop(void* pool);
+	FiberScheduler* localScheduler();
+	bool quiet(FiberScheduler* sched) const;
+	int64_t allowed() const;
+	PoolTask* search(const int64_t slot);
+	bool park(const int64_t slot);
+	void grow();
+	bool retire(const int64_t slot, const bool idle);
+	int64_t localSlot();
+	PoolTask* findWork(const int64_t slot);
+	PoolTask* stealWork(const int64_t slot);
+	PoolTask* takeInbox(const int64_t slot);
+	void pinWorker(const int64_t slot);
+	int64_t cpuNode(const int cpu) const;
+	std::vector<WorkStealingDeque*> deques;
+	std::vector<Inbox*> inboxes; //per slot, next to the deque
+	std::vector<pthread_t> threads; //indexed by slot, retired workers are joined on reuse
+	std::vector<char> joinable;
+	std::vector<char*> stacks; //per slot, mapped by the first worker and kept for the next
+	size_t stackSize; //of worker threads and fibers
+	std::vector<int64_t> freeSlots; //slots of retired workers
+	std::vector<char> workerSlots; //slot is owned by a worker rather than an external thread
+	std::vector<FiberScheduler*> schedulers; //per slot, kept for the next owner of the slot
+	std::vector<std::vector<int> > nodes; //allowed CPUs of every NUMA node
+	PinMode pin;
+	std::vector<std::atomic<int64_t> > slotNodes; //node of every slot, read by thieves
+	std::vector<int> slotCpus; //CPU a worker is pinned to, -1 if none
+	std::vector<int64_t> nodeWorkers; //live workers per node, under spawnMutex
+	std::vector<char> cpuTaken; //CPUs with a pinned worker, under spawnMutex
+	bool fibers;
+	int64_t ceiling;
+	std::atomic<int64_t> limit;
+	int64_t compensation; //most extra workers for blocked ones
+	std::atomic<int64_t> blocked; //workers inside a blocking region
+	std::atomic<int64_t> blockings; //blocking regions entered by workers
+	std::atomic<int64_t> live;
+	std::atomic<int64_t> slotCount;
+	std::atomic<int64_t> epoch;
+	std::atomic<int64_t> sleepers;
+	std::atomic<bool> waking; //a parked worker was notified and has not looked for work yet
+	std::atomic<int64_t> searching; //workers looking for work before they park
+	std::atomic<bool> running;
+	std::mutex parkMutex;
+	std::condition_variable parkCondition;
+	std::mutex spawnMutex;
+	int64_t spawned;
+	int64_t retired;
+	int64_t peak;
+};
+
+#endif /* __WORKERPOOL_H */
@@ -65,6 +65,8 @@ std::vector<Statement*,gc_allocator<Statement*>>* buildInjections() {
 	char* c__recon_floatptr = (char*)GC_MALLOC_ATOMIC(32);
 	char* c__recon_void = (char*)GC_MALLOC_ATOMIC(32);
 	char* c__destroy_context = (char*)GC_MALLOC_ATOMIC(32);
+	char* c__fork_sched_group = (char*)GC_MALLOC_ATOMIC(32);
+	char* c__recon_group = (char*)GC_MALLOC_ATOMIC(32);
 	char* c_func = (char*)GC_MALLOC_ATOMIC(8);
 	char* c_env = (char*)GC_MALLOC_ATOMIC(8);
 	char* c_id = (char*)GC_MALLOC_ATOMIC(8);
@@ -72,6 +74,9 @@ std::vector<Statement*,gc_allocator<Statement*>>* buildInjections() {
 	char* c_original = (char*)GC_MALLOC_ATOMIC(32);
 	char* c_known = (char*)GC_MALLOC_ATOMIC(8);
 	char* c_max = (char*)GC_MALLOC_ATOMIC(8);
+	char* c_descriptors = (char*)GC_MALLOC_ATOMIC(16);
+	char* c_results = (char*)GC_MALLOC_ATOMIC(8);
+	char* c_n = (char*)GC_MALLOC_ATOMIC(8);
 	char* cmalloc_int = (char*)GC_MALLOC_ATOMIC(32);
 	char* cmalloc_float = (char*)GC_MALLOC_ATOMIC(32);
 	char* ccalloc_int = (char*)GC_MALLOC_ATOMIC(32);
@@ -99,6 +104,8 @@ std::vector<Statement*,gc_allocator<Statement*>>* buildInjections() {
 	std::strcpy(c__recon_intptr,"__recon_intptr");
 	std::strcpy(c__recon_floatptr,"__recon_floatptr");
 	std::strcpy(c__recon_void,"__recon_void");
+	std::strcpy(c__fork_sched_group,"__fork_sched_group");
+	std::strcpy(c__recon_group,"__recon_group");
 	std::strcpy(c_func,"func");
 	std::strcpy(c_env,"env");
 	std::strcpy(c_id,"id");
@@ -106,6 +113,9 @@ std::vector<Statement*,gc_allocator<Statement*>>* buildInjections() {
 	std::strcpy(c_original,"original");
 	std::strcpy(c_known,"known");
 	std::strcpy(c_max,"max");
+	std::strcpy(c_descriptors,"descriptors");
+	std::strcpy(c_results,"results");
+	std::strcpy(c_n,"n");
 	Keyword* kvoid = new Keyword(cvoid); //Keywords
 	Keyword* kint = new Keyword(cint);
 	Keyword* kfloat = new Keyword(cfloat);
@@ -121,6 +131,8 @@ std::vector<Statement*,gc_allocator<Statement*>>* buildInjections() {
 	Identifier* i__recon_floatptr = new Identifier(c__recon_floatptr);
 	Identifier* i__recon_void = new Identifier(c__recon_void);
 	Identifier* i__destroy_context = new Identifier(c__destroy_context);
+	Identifier* i__fork_sched_group = new Identifier(c__fork_sched_group);
+	Identifier* i__recon_group = new Identifier(c__recon_group);
 	Identifier* imalloc_int = new Identifier(cmalloc_int);
 	Identifier* imalloc_float = new Identifier(cmalloc_float);
 	Identifier* icalloc_int = new Identifier(ccalloc_int);
@@ -132,6 +144,9 @@ std::vector<Statement*,gc_allocator<Statement*>>* buildInjections() {
 	VariableDefinition* vid = new VariableDefinition(kint,new Identifier(c_id),nullptr,false);
 	VariableDefinition* vcid = new VariableDefinition(kint,new Identifier(c_cid),nullptr,false);
 	VariableDefinition* vmax = new VariableDefinition(kint,new Identifier(c_max),nullptr,false);
+	VariableDefinition* vdescriptors = new VariableDefinition(kvoid,new Identifier(c_descriptors),nullptr,true);
+	VariableDefinition* vresults = new VariableDefinition(kint,new Identifier(c_results),nullptr,true);
+	VariableDefinition* vn = new VariableDefinition(kint,new Identifier(c_n),nullptr,false);
 	VariableDefinition* vknownint = new VariableDefinition(kint,new Identifier(c_known),nullptr,false);
 	VariableDefinition* vknownintptr = new VariableDefinition(kint,new Identifier(c_known),nullptr,true);
 	VariableDefinition* vknownfloat = new VariableDefinition(kfloat,new Identifier(c_known),nullptr,false);
@@ -142,6 +157,7 @@ std::vector<Statement*,gc_allocator<Statement*>>* buildInjections() {
 	VariableDefinition* voriginalfloatptr = new VariableDefinition(kfloat,new Identifier(c_original),nullptr,true);
 
 	auto v__make_context = new std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>(); //Call vectors
+	v__make_context->push_back(vmax);
 	auto vmalloc_int = new std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>();
 	vmalloc_int->push_back(vid);
 	auto vmalloc_float = new std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>();
@@ -207,6 +223,14 @@ std::vector<Statement*,gc_allocator<Statement*>>* buildInjections() {
 	v__recon_void->push_back(vid);
 	v__recon_void->push_back(vmax);
 	v__recon_void->push_back(vcid);
+	auto v__fork_sched_group = new std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>();
+	v__fork_sched_group->push_back(vdescriptors);
+	v__fork_sched_group->push_back(vn);
+	v__fork_sched_group->push_back(vcid);
+	auto v__recon_group = new std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>();
+	v__recon_group->push_back(vresults);
+	v__recon_group->push_back(vn);
+	v__recon_group->push_back(vcid);
 	auto v__destroy_context = new std::vector<VariableDefinition*,gc_allocator<VariableDefinition*>>();
 	v__destroy_context->push_back(vcid);
 	injections->push_back(new ExternStatement(kint,imalloc_int,vmalloc_int,true,true));
@@ -226,6 +250,8 @@ std::vector<Statement*,gc_allocator<Statement*>>* buildInjections() {
 	injections->push_back(new ExternStatement(kint,i__recon_intptr,v__recon_intptr,true,true));
 	injections->push_back(new ExternStatement(kfloat,i__recon_floatptr,v__recon_floatptr,true,true));
 	injections->push_back(new ExternStatement(kvoid,i__recon_void,v__recon_void,false,true));
+	injections->push_back(new ExternStatement(kvoid,i__fork_sched_group,v__fork_sched_group,false,true));
+	injections->push_back(new ExternStatement(kvoid,i__recon_group,v__recon_group,false,true));
 	injections->push_back(new ExternStatement(kvoid,i__destroy_context,v__destroy_context,false,true));
 	return injections;
 }